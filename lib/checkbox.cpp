@@ -1,6 +1,5 @@
 #include "checkbox.h"
 #include "bb.h"
-#include "codeconv.h"
 #include "gl.h"
 #include "layer.h"
 #include "primitive2d.h"
@@ -22,9 +21,9 @@ struct Item : public Base
   using Color = Graphics::Color;
   struct Info
   {
-    std::string label;
-    double      length;
-    Color       color;
+    FontDraw::TextRunPtr label = FontDraw::createTextRun();
+    double               length;
+    Color                color;
   };
   ~Item() = default;
   Info    on_info;
@@ -87,13 +86,13 @@ Item::draw(bool focus)
 
   auto loc = bbox.getLocate();
   auto btm = bbox.getBottom();
-  Primitive2D::drawBox(loc.x, loc.y, btm.x, btm.y, Graphics::Gray, false);
+  Primitive2D::drawRect(loc.x, loc.y, btm.x, btm.y, Graphics::ClearColor,
+                        Graphics::Gray);
 
   auto& info   = value ? on_info : off_info;
   auto  offset = (length - info.length) * 0.5;
-  auto  pos    = Graphics::calcLocate(loc.x + 20 + offset, loc.y + 42);
   font->setColor(info.color);
-  font->print(info.label.c_str(), pos.x, pos.y);
+  font->printPixel(info.label, loc.x + 20 + offset, loc.y + 42);
 
   Graphics::disableScissor();
   font->clearDrawArea();
@@ -103,7 +102,7 @@ Item::draw(bool focus)
 double
 Item::setBBox(const std::string& s)
 {
-  double l = CodeConv::U8Length2(s.c_str()) * 21.0;
+  double l = font->measure(s.c_str()).width;
   if (l > length)
   {
     auto rx = x + l + 20 + 20;
@@ -119,7 +118,7 @@ Item::setBBox(const std::string& s)
 void
 Item::setText(std::string str)
 {
-  on_info.label  = str;
+  on_info.label->set(str);
   on_info.length = setBBox(str);
 }
 
@@ -127,7 +126,7 @@ Item::setText(std::string str)
 void
 Item::setOffText(std::string str)
 {
-  off_info.label  = str;
+  off_info.label->set(str);
   off_info.length = setBBox(str);
 }
 
@@ -1,6 +1,5 @@
 #include "dialog.h"
 #include "bb.h"
-#include "codeconv.h"
 #include "gl.h"
 #include "primitive2d.h"
 #include "texture2d.h"
@@ -69,7 +68,7 @@ struct Body : public Base
     max_length = 0;
     for (auto& s : message)
     {
-      auto l = CodeConv::U8Length2(s.c_str());
+      auto l = font->measure(s.c_str()).width;
       if (l > max_length)
         max_length = l;
       offset.push_back(l);
@@ -197,9 +196,8 @@ Body::draw()
   auto ofs = offset.begin();
   for (auto& m : message)
   {
-    auto o = (max_length - *ofs) * 0.5 * 21.0;
-    auto p = Graphics::calcLocate(x + 300 + o, dy);
-    font->print(m.c_str(), p.x, p.y);
+    auto o = (max_length - *ofs) * 0.5;
+    font->printPixel(m.c_str(), x + 300 + o, dy);
     dy += 50;
     ofs++;
   }
@@ -208,16 +206,14 @@ Body::draw()
   auto btm  = bb_ok.getBottom();
   auto bcol = sel_state == Select::OK ? Graphics::Green : Graphics::White;
   Primitive2D::drawBox(loc.x, loc.y, btm.x, btm.y, bcol, false);
-  auto bfpos = Graphics::calcLocate(loc.x + 30, loc.y + 42);
-  font->print("OK", bfpos.x, bfpos.y);
+  font->printPixel("OK", loc.x + 30, loc.y + 42);
   if (need_cancel)
   {
     loc  = bb_cancel.getLocate();
     btm  = bb_cancel.getBottom();
     bcol = sel_state == Select::Cancel ? Graphics::Red : Graphics::White;
     Primitive2D::drawBox(loc.x, loc.y, btm.x, btm.y, bcol, false);
-    auto bfpos = Graphics::calcLocate(loc.x + 30, loc.y + 42);
-    font->print("CANCEL", bfpos.x, bfpos.y);
+    font->printPixel("CANCEL", loc.x + 30, loc.y + 42);
   }
 }
 
@@ -246,7 +242,7 @@ create(std::string msg, bool need_cancel)
 {
   auto dlg = std::make_shared<Body>();
   dlg->set_message(msg);
-  dlg->width       = dlg->max_length * font->getSizeX() + 300 * 2;
+  dlg->width       = dlg->max_length + 300 * 2;
   dlg->height      = dlg->message.size() * font->getSizeY() + 330;
   dlg->need_cancel = need_cancel;
   dlg->sel_state   = Select::None;
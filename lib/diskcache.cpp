@@ -0,0 +1,324 @@
+#include "diskcache.h"
+#include "fontface.h"
+#include "mapfile.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+
+//
+// ファイル構成
+//   Header
+//   Entry[count] (コードポイント順)
+//   ビットマップデータ
+// フォントファイルの識別値・サイズ・チェックサムが合わなければ作り直す
+//
+namespace DiskCache
+{
+namespace
+{
+namespace fs = std::filesystem;
+
+constexpr char     Magic[4]     = {'G', 'L', 'Y', 'C'};
+constexpr uint32_t Version      = 3; // 3: 送り幅をヒンティング前の値に揃えた
+constexpr size_t   FontHeadSize = 4096; // 識別に使うフォントファイルの先頭
+
+struct Header
+{
+  char     magic[4];
+  uint32_t version;
+  uint64_t font_hash;
+  uint32_t size;
+  uint32_t count;
+  uint64_t data_size;
+  uint64_t checksum;
+};
+
+struct Entry
+{
+  uint32_t code;
+  uint16_t width;
+  uint16_t height;
+  float    left;
+  float    top;
+  float    ad_x;
+  float    ad_y;
+  uint32_t offset;
+};
+
+// キャッシュファイル1つ分(フェイス,サイズ)
+struct CacheFile
+{
+  MapFile::HandlePtr map;
+  const Header*      header  = nullptr;
+  const Entry*       entries = nullptr;
+  const uint8_t*     data    = nullptr;
+  bool               tried   = false;
+};
+
+using FileKey = std::pair<int, int>;
+std::string                  directory;
+std::map<int, uint64_t>      font_hashes; // 0は失敗
+std::map<FileKey, CacheFile> files;
+
+// FNV-1a
+uint64_t
+fnv1a(const uint8_t* p, size_t len, uint64_t h = 14695981039346656037ULL)
+{
+  for (size_t i = 0; i < len; i++)
+  {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+// フォントファイルの識別値
+// 全体を読むと大きなフォントで描画が止まるので、サイズと更新日時に
+// 先頭(sfntならテーブル毎のチェックサムを持つディレクトリ)だけを混ぜる
+bool
+getFontHash(int face, uint64_t& ret)
+{
+  auto it = font_hashes.find(face);
+  if (it == font_hashes.end())
+  {
+    // フォントファイルは登録時にマップ済み
+    auto     file = FontFace::getFile(face);
+    uint64_t hash = 0;
+    if (file)
+    {
+      std::error_code ec;
+      auto            name  = FontFace::getName(face);
+      auto            mtime = fs::last_write_time(name, ec);
+      int64_t         id[2] = {(int64_t)file->size(), 0};
+      if (!ec)
+        id[1] = mtime.time_since_epoch().count();
+      hash = fnv1a((const uint8_t*)id, sizeof(id));
+      hash = fnv1a(file->data(), std::min(file->size(), FontHeadSize), hash);
+    }
+    it = font_hashes.emplace(face, hash).first;
+  }
+  ret = it->second;
+  return ret != 0;
+}
+
+//
+std::string
+getFileName(uint64_t font_hash, int size)
+{
+  char buff[64];
+  std::snprintf(buff, sizeof(buff), "%016llx_%d.glc",
+                (unsigned long long)font_hash, size);
+  return (fs::path(directory) / buff).string();
+}
+
+// キャッシュファイルを開いて検証する
+bool
+openFile(CacheFile& cf, int face, int size)
+{
+  cf.tried = true;
+  uint64_t fh;
+  if (!getFontHash(face, fh))
+    return false;
+
+  auto fname = getFileName(fh, size);
+  auto map   = MapFile::open(fname.c_str());
+  if (!map)
+    return false;
+
+  auto invalid = [&](const char* msg) {
+    std::cerr << "glyph cache rebuild(" << msg << "): " << fname << std::endl;
+    return false;
+  };
+  if (map->size() < sizeof(Header))
+    return invalid("size");
+  auto hd = (const Header*)map->data();
+  if (std::memcmp(hd->magic, Magic, sizeof(Magic)) != 0 ||
+      hd->version != Version)
+    return invalid("version");
+  if (hd->font_hash != fh || hd->size != (uint32_t)size)
+    return invalid("stale");
+  size_t isize = sizeof(Entry) * hd->count;
+  if (map->size() != sizeof(Header) + isize + hd->data_size)
+    return invalid("size");
+  auto body = map->data() + sizeof(Header);
+  if (fnv1a(body, isize + hd->data_size) != hd->checksum)
+    return invalid("checksum");
+  auto ent = (const Entry*)body;
+  for (uint32_t i = 0; i < hd->count; i++)
+  {
+    auto& e = ent[i];
+    if (e.offset + (uint64_t)e.width * e.height > hd->data_size)
+      return invalid("entry");
+  }
+
+  cf.map     = map;
+  cf.header  = hd;
+  cf.entries = ent;
+  cf.data    = body + isize;
+  return true;
+}
+
+// エントリから文字を取り出す
+void
+toGlyph(const CacheFile& cf, const Entry& e, GlyphCache::Glyph& glyph)
+{
+  auto src = cf.data + e.offset;
+  glyph.buffer.assign(src, src + e.width * e.height);
+  glyph.width  = e.width;
+  glyph.height = e.height;
+  glyph.left   = e.left;
+  glyph.top    = e.top;
+  glyph.ad_x   = e.ad_x;
+  glyph.ad_y   = e.ad_y;
+}
+
+// 書き出し
+bool
+writeFile(int face, int size, const std::map<char32_t, GlyphCache::Glyph>& gl)
+{
+  uint64_t fh;
+  if (!getFontHash(face, fh))
+    return false;
+
+  std::vector<Entry>   ent;
+  std::vector<uint8_t> data;
+  ent.reserve(gl.size());
+  for (auto& g : gl)
+  {
+    Entry e;
+    e.code   = g.first;
+    e.width  = g.second.width;
+    e.height = g.second.height;
+    e.left   = g.second.left;
+    e.top    = g.second.top;
+    e.ad_x   = g.second.ad_x;
+    e.ad_y   = g.second.ad_y;
+    e.offset = data.size();
+    data.insert(data.end(), g.second.buffer.begin(), g.second.buffer.end());
+    ent.push_back(e);
+  }
+
+  Header hd;
+  std::memcpy(hd.magic, Magic, sizeof(Magic));
+  hd.version   = Version;
+  hd.font_hash = fh;
+  hd.size      = size;
+  hd.count     = ent.size();
+  hd.data_size = data.size();
+  hd.checksum  = fnv1a((const uint8_t*)ent.data(), sizeof(Entry) * ent.size());
+  hd.checksum  = fnv1a(data.data(), data.size(), hd.checksum);
+
+  // 一旦別名で書き出してから置き換える
+  std::error_code ec;
+  fs::create_directories(directory, ec);
+  auto fname = getFileName(fh, size);
+  auto tname = fname + ".tmp";
+  {
+    std::ofstream ofs(tname, std::ios::binary | std::ios::trunc);
+    if (!ofs)
+      return false;
+    ofs.write((const char*)&hd, sizeof(hd));
+    ofs.write((const char*)ent.data(), sizeof(Entry) * ent.size());
+    ofs.write((const char*)data.data(), data.size());
+    if (!ofs)
+      return false;
+  }
+  files.erase({face, size});
+  fs::rename(tname, fname, ec);
+  if (ec)
+  {
+    fs::remove(tname, ec);
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+//
+void
+setDirectory(const char* dir)
+{
+  directory = dir ? dir : "";
+  files.clear();
+}
+
+//
+bool
+load(GlyphCache::Key key, GlyphCache::Glyph& glyph)
+{
+  if (directory.empty())
+    return false;
+
+  int   face = GlyphCache::keyFace(key);
+  int   size = GlyphCache::keySize(key);
+  auto& cf   = files[{face, size}];
+  if (!cf.tried)
+    openFile(cf, face, size);
+  if (!cf.map)
+    return false;
+
+  uint32_t code = GlyphCache::keyCode(key);
+  auto     last = cf.entries + cf.header->count;
+  auto     it   = std::lower_bound(cf.entries, last, code,
+                               [](auto& e, uint32_t c) { return e.code < c; });
+  if (it == last || it->code != code)
+    return false;
+
+  toGlyph(cf, *it, glyph);
+  return true;
+}
+
+//
+size_t
+save()
+{
+  if (directory.empty())
+    return 0;
+
+  // 既存ファイルの内容とメモリ上の内容をまとめる
+  std::map<FileKey, std::map<char32_t, GlyphCache::Glyph>> list;
+  for (auto& f : files)
+  {
+    auto& cf = f.second;
+    if (!cf.map)
+      continue;
+    auto& gl = list[f.first];
+    for (uint32_t i = 0; i < cf.header->count; i++)
+    {
+      auto& e = cf.entries[i];
+      toGlyph(cf, e, gl[e.code]);
+    }
+  }
+  GlyphCache::forEach([&](GlyphCache::Key key, const GlyphCache::Glyph& g) {
+    int face = GlyphCache::keyFace(key);
+    if (!FontFace::getFile(face))
+      return;
+    auto& dst = list[{face, GlyphCache::keySize(key)}];
+    dst[GlyphCache::keyCode(key)] = g;
+  });
+
+  size_t count = 0;
+  for (auto& l : list)
+  {
+    if (writeFile(l.first.first, l.first.second, l.second))
+      count += l.second.size();
+  }
+  return count;
+}
+
+//
+void
+terminate()
+{
+  files.clear();
+  font_hashes.clear();
+}
+
+} // namespace DiskCache
@@ -0,0 +1,17 @@
+// glyph disk cache utility
+#pragma once
+
+#include "glyphcache.h"
+
+namespace DiskCache
+{
+// キャッシュファイルの置き場所(nullptrか空文字列で無効)
+void setDirectory(const char* dir);
+// キャッシュファイルから文字を取り出す
+bool load(GlyphCache::Key key, GlyphCache::Glyph& glyph);
+// メモリ上の文字をキャッシュファイルへ書き出す(書き出した文字数を返す)
+size_t save();
+//
+void terminate();
+
+} // namespace DiskCache
@@ -1,11 +1,31 @@
 #include "font.h"
 #include "codeconv.h"
+#include "diskcache.h"
+#include "fontface.h"
 #include "gl.h"
+#include "glyphcache.h"
+#include "rasterizer.h"
+#include "shader.h"
+#include "shaper.h"
+#include "streambuffer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
 #include <ft2build.h>
 #include <iostream>
+#include <iterator>
 #include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include FT_FREETYPE_H
+#include FT_ADVANCES_H
+#include FT_SIZES_H
 
 //
 // 以下のサイトを参考にした
@@ -17,80 +37,286 @@ namespace FontDraw
 
 namespace
 {
-FT_Library ft;
-GLuint     vbo;
-GLuint     vertex_shader, fragment_shader, program;
-GLint      attribute_coord, uniform_color, uniform_tex, DEPTH;
+FT_Library ft = nullptr;
+GLuint     vertex_shader, fragment_shader, sdf_shader;
+GLuint     program, sdf_program;
+GLuint     vertex_array = 0; // コアプロファイル用(使えなければ0)
 float      DrawDepth = 0.0f;
+Statistics stats{};
 
-const char* vertex_shader_text = "#version 120\n"
+// シェーダは2.xの書き方で、バージョン行はShader::compileで付ける
+const char* vertex_shader_text = "uniform mat4 MVP;\n"
                                  "attribute vec4 coord;\n"
+                                 "attribute vec4 vcolor;\n"
+                                 "attribute float vdepth;\n"
                                  "varying vec2 texcoord;\n"
-                                 "uniform float Depth;\n"
+                                 "varying vec4 color;\n"
                                  "void main(void) {\n"
-                                 "  gl_Position = vec4(coord.xy, Depth, 1);\n"
+                                 "  gl_Position = MVP * vec4(coord.xy, vdepth, 1);\n"
                                  "  texcoord    = coord.zw;\n"
+                                 "  color       = vcolor;\n"
                                  "}";
 const char* fragment_shader_text =
-    "#version 120\n"
     "varying vec2 texcoord;\n"
+    "varying vec4 color;\n"
     "uniform sampler2D tex;\n"
-    "uniform vec4 color;\n"
     "void main(void) {\n"
     "  gl_FragColor = vec4(1, 1, 1, texture2D(tex, texcoord).r) * color;\n"
     "}";
+// 距離場(SDF)用: 0.5を輪郭として画面上の1ピクセル幅でぼかす
+// 縁取りは閾値を下げた範囲、影はずらした位置の距離場で同時に描く
+const char* sdf_shader_text =
+    "varying vec2 texcoord;\n"
+    "varying vec4 color;\n"
+    "uniform sampler2D tex;\n"
+    "uniform float outline;\n"
+    "uniform vec4 outline_color;\n"
+    "uniform vec2 shadow_offset;\n"
+    "uniform vec4 shadow_color;\n"
+    "void main(void) {\n"
+    "  float d  = texture2D(tex, texcoord).r;\n"
+    "  float sd = texture2D(tex, texcoord - shadow_offset).r;\n"
+    "  float w  = max(fwidth(d) * 0.5, 1.0 / 255.0);\n"
+    "  float e  = 0.5 - outline;\n"
+    "  float fa = color.a * smoothstep(0.5 - w, 0.5 + w, d);\n"
+    "  float oa = outline_color.a * smoothstep(e - w, e + w, d);\n"
+    "  float sa = shadow_color.a * smoothstep(e - w, e + w, sd);\n"
+    "  vec4  c  = vec4(shadow_color.rgb * sa, sa);\n"
+    "  c = vec4(outline_color.rgb * oa, oa) + c * (1.0 - oa);\n"
+    "  c = vec4(color.rgb * fa, fa) + c * (1.0 - fa);\n"
+    "  gl_FragColor = vec4(c.rgb / max(c.a, 1.0 / 255.0), c.a);\n"
+    "}";
+// 縁取り・影のuniformの位置
+GLint u_outline, u_outline_color, u_shadow_offset, u_shadow_color;
+GLint u_mvp[2]; // 通常, 距離場
+
+// 頂点属性の位置(両方のシェーダで共通)
+enum Attribute : GLuint
+{
+  AttrCoord,
+  AttrColor,
+  AttrDepth,
+};
+
+// 頂点1つ分(色と深度も頂点に持たせる)
+struct FontVertex
+{
+  float x, y, u, v;
+  float r, g, b, a;
+  float depth;
+};
 
 // 色
 using Color    = Graphics::Color;
 using DrawArea = Graphics::DrawArea;
+using View     = Graphics::View;
+
+// 縁取りと影(距離場のシェーダで文字と一緒に描く)
+struct Decoration
+{
+  float outline = 0.0f; // 輪郭の太さ
+  Color outline_color{0.0f, 0.0f, 0.0f, 0.0f};
+  float shadow_x = 0.0f; // 影のずらし量(下が正)
+  float shadow_y = 0.0f;
+  Color shadow_color{0.0f, 0.0f, 0.0f, 0.0f};
+
+  bool enabled() const { return outline > 0.0f || shadow_color.a > 0.0f; }
+  bool same(const Decoration& o) const
+  {
+    auto sc = [](const Color& a, const Color& b) {
+      return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+    };
+    return outline == o.outline && shadow_x == o.shadow_x &&
+           shadow_y == o.shadow_y && sc(outline_color, o.outline_color) &&
+           sc(shadow_color, o.shadow_color);
+  }
+};
+
+class TextRunImpl;
 
 // フォント描画1つ分
 struct DrawSet
 {
   static constexpr float DefaultSize = 32.0f;
 
-  FT_Face     face   = nullptr;
-  float       width  = DefaultSize;
-  float       height = DefaultSize;
-  float       x      = 0.0f;
-  float       y      = 0.0f;
-  float       depth  = 0.0f;
-  float       scale  = 1.0f;
+  FT_Face     face    = nullptr;
+  FT_Size     ft_size = nullptr;
+  int         face_id = 0;
+  float       width   = DefaultSize;
+  float       height  = DefaultSize;
+  float       x       = 0.0f; // ウィンドウのピクセル
+  float       y       = 0.0f;
+  float       depth   = 0.0f;
+  float       scale   = 1.0f;
+  bool        sdf     = false;
+  bool        shaping = false;
+  Decoration  deco{};
   DrawArea    da{};
+  View        view{};
   Color       color{};
   const char* msg = nullptr;
+
+  std::shared_ptr<TextRunImpl> run; // 配置済みの文字列(msgの代わり)
 };
 std::vector<char>    message_buffer;
 std::vector<DrawSet> draw_set;
 
+// 1回の描画コマンド分(ページ・シェーダ・シザリング・ビューが変わったら分割)
+struct Batch
+{
+  int        page;
+  bool       sdf;
+  DrawArea   da;
+  View       view;
+  Decoration deco; // シェーダの単位に変換済み
+  GLint      first;
+  GLsizei    count;
+};
+std::vector<FontVertex> vertex_list;
+std::vector<Batch>      batch_list;
+
+// 配置済みの文字1つ分(原点からのピクセル単位, 上が正)
+struct RunGlyph
+{
+  float x1, y1, x2, y2;
+  float u0, v0, u1, v1;
+  int   page;
+};
+using RunGlyphList = std::vector<RunGlyph>;
+using KeyList      = std::vector<GlyphCache::Key>;
+RunGlyphList scratch; // 毎回配置する文字列用
+
+bool   layout(const DrawSet& ds, const char* msg, RunGlyphList& out,
+              KeyList* keys = nullptr);
+size_t getFallbackCount();
+
+//
+// 配置済み文字列の実装
+class TextRunImpl : public TextRun
+{
+  std::string text;
+  FT_Face     face       = nullptr;
+  float       height     = 0.0f;
+  bool        sdf        = false;
+  bool        shaping    = false;
+  bool        valid      = false;
+  uint32_t    generation = 0;
+  size_t      fallbacks  = 0;
+
+public:
+  RunGlyphList glyphs;
+  KeyList      keys; // 配置に使った文字(使い続ける間は追い出させない)
+
+  TextRunImpl(const std::string& msg) : text(msg) {}
+  ~TextRunImpl() override = default;
+
+  void set(const std::string& msg) override
+  {
+    if (msg == text)
+      return;
+    text  = msg;
+    valid = false;
+  }
+  const std::string& get() const override { return text; }
+
+  // 文字列かフォントが変わった時と、文字キャッシュが動いた時だけ組み直す
+  void update(const DrawSet& ds)
+  {
+    auto gen = GlyphCache::getGeneration();
+    auto fbc = getFallbackCount();
+    if (valid && face == ds.face && height == ds.height && sdf == ds.sdf &&
+        shaping == ds.shaping && generation == gen && fallbacks == fbc)
+    {
+      // 引き直さないので、このフレームで使った印だけ付ける
+      for (auto key : keys)
+        GlyphCache::touch(key);
+      return;
+    }
+    face       = ds.face;
+    height     = ds.height;
+    sdf        = ds.sdf;
+    shaping    = ds.shaping;
+    generation = gen;
+    fallbacks  = fbc;
+    // ラスタライズ待ちの文字があれば次のフレームでやり直す
+    valid = layout(ds, text.c_str(), glyphs, &keys);
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  }
+};
+
 //
 // ウィジェット実装
 //
 class WidgetImpl : public Widget
 {
-  FT_Face  face;
+  // 寸法のメモ化の上限(超えたら捨てる)
+  static constexpr size_t MeasureCacheMax = 1024;
+
+  FT_Face  face    = nullptr; // 同じファイルのウィジェットで共有
+  FT_Size  ft_size = nullptr; // サイズはウィジェット毎
   DrawSet  current;
   bool     valid;
   float    depth;
-  float    sdepth;
   float    scale;
   DrawArea da;
+  float    cell_width;    // 半角1文字の幅
+  float    mono_half = 0; // 等幅フォントの半角の幅(等幅でなければ0)
+  float    mono_full = 0; // 等幅フォントの全角の幅
+  float    line_height;   // 行の高さ
+  Metrics  line{};        // 行の上下の寸法
+  size_t   fallbacks = 0; // 寸法を測った時の代替フォントの数
+
+  std::vector<float> depth_stack; // pushDepthで退避した深度
+
+  // 寸法はスケール無しで保持する
+  std::unordered_map<char32_t, float>      advance_cache;
+  std::unordered_map<std::string, Metrics> measure_cache;
+
+  void  applySize();
+  float advance(char32_t ch);
 
 public:
   WidgetImpl(const char* fontname);
-  ~WidgetImpl() override = default;
+  ~WidgetImpl() override;
 
   void setSize(float w, float h) override;
   void setColor(Graphics::Color c) override;
   void setScale(float s) override { scale = s; }
+  void setSDF(bool s) override { current.sdf = s; }
+  void setShaping(bool s) override
+  {
+    current.shaping = s;
+    measure_cache.clear();
+  }
+  void setOutline(float w, Graphics::Color c) override
+  {
+    current.deco.outline       = w;
+    current.deco.outline_color = c;
+  }
+  void setShadow(float x, float y, Graphics::Color c) override
+  {
+    current.deco.shadow_x     = x;
+    current.deco.shadow_y     = y;
+    current.deco.shadow_color = c;
+  }
   void print(const char* msg, float x, float y) override;
+  void print(const TextRunPtr& text, float x, float y) override;
+  void printPixel(const char* msg, double x, double y) override;
+  void printPixel(const TextRunPtr& text, double x, double y) override;
   void setDepth(float d) override { depth = d; }
   void pushDepth(float d) override
   {
-    sdepth = depth;
-    depth  = d;
+    depth_stack.push_back(depth);
+    depth = d;
+  }
+  void popDepth() override
+  {
+    if (depth_stack.empty())
+      return;
+    depth = depth_stack.back();
+    depth_stack.pop_back();
   }
-  void popDepth() override { depth = sdepth; }
   void setDrawArea(double x, double y, double w, double h) override
   {
     da.x = x;
@@ -99,57 +325,287 @@ public:
     da.h = h;
     da.e = true;
   }
-  void  clearDrawArea() override { da.e = false; }
-  float getSizeX() const override { return 21.0f * scale; }
-  float getSizeY() const override { return 42.0f * scale; }
-  float getScale() const override { return scale; }
+  void    clearDrawArea() override { da.e = false; }
+  Metrics measure(const char* msg) override;
+  float   getSizeX() const override { return cell_width * scale; }
+  float   getSizeY() const override { return line_height * scale; }
+  float   getScale() const override { return scale; }
+  bool    isMonospace() const override { return mono_half > 0.0f; }
+
+  bool           isValid() const { return valid; }
+  const DrawSet& getCurrent() const { return current; }
 };
 
-// 文字テクスチャキャッシュ
-struct MyGlyph
-{
-  using Buffer = std::vector<uint8_t>;
-  Buffer buffer;
-  double width;
-  double height;
-  double left;
-  double top;
-  double ad_x;
-  double ad_y;
-  bool   init = false;
-  GLuint tex;
-
-  ~MyGlyph() { clear(); }
-
-  void setup(const FT_GlyphSlot& g)
-  {
-    size_t sz = g->bitmap.width * g->bitmap.rows;
-    buffer.resize(sz);
-    memcpy(buffer.data(), g->bitmap.buffer, sz);
-    width  = g->bitmap.width;
-    height = g->bitmap.rows;
-    left   = g->bitmap_left;
-    top    = g->bitmap_top;
-    ad_x   = g->advance.x;
-    ad_y   = g->advance.y;
-    init   = true;
-
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED,
-                 GL_UNSIGNED_BYTE, buffer.data());
-  }
-
-  void bind() { glBindTexture(GL_TEXTURE_2D, tex); }
-
-  void clear() { glDeleteTextures(1, &tex); }
+// フォントファイル毎に1つだけ作るフェイス(IDはキャッシュのキーに使う)
+struct SharedFace
+{
+  FT_Face               face = nullptr;
+  std::vector<uint64_t> coverage; // 含まれる文字のビットマップ
+  FT_Fixed              mono_half = 0; // 等幅なら半角の送り幅(フォント単位)
+  FT_Fixed              mono_full = 0; // 等幅なら全角の送り幅(フォント単位)
+  std::vector<uint64_t> wide;          // 等幅で全角幅の文字
+  std::vector<uint64_t> zero;          // 等幅で幅0の文字(結合文字など)
+
+  static bool test(const std::vector<uint64_t>& bits, char32_t ch)
+  {
+    size_t i = ch >> 6;
+    return i < bits.size() && ((bits[i] >> (ch & 63)) & 1);
+  }
+  static void mark(std::vector<uint64_t>& bits, char32_t ch)
+  {
+    size_t i = ch >> 6;
+    if (i >= bits.size())
+      bits.resize(i + 1, 0);
+    bits[i] |= 1ull << (ch & 63);
+  }
+  bool has(char32_t ch) const { return test(coverage, ch); }
+  // 等幅の時の送り幅(half, fullは半角と全角の幅)
+  float monoWidth(char32_t ch, float half, float full) const
+  {
+    return test(wide, ch) ? full : test(zero, ch) ? 0.0f : half;
+  }
+  bool isHalf(char32_t ch) const
+  {
+    return !test(wide, ch) && !test(zero, ch);
+  }
 };
-std::map<int, MyGlyph> glyphs;
+std::map<int, SharedFace> shared_faces;
+
+const SharedFace&
+getShared(int id)
+{
+  auto it = shared_faces.find(id);
+  if (it != shared_faces.end())
+    return it->second;
+
+  auto& sf = shared_faces[id];
+  sf.face  = FontFace::openFace(ft, id);
+  if (sf.face)
+  {
+    // 文字マップを1度だけ走査しておく
+    // 全ての送り幅が半角か全角(か0)なら等幅として扱う
+    // 全角は半角の2倍とは限らない(Source Han Codeは半角が2/3幅)
+    FT_Fixed half = 0;
+    FT_Fixed full = 0;
+    if (FT_IS_SCALABLE(sf.face))
+      FT_Get_Advance(sf.face, FT_Get_Char_Index(sf.face, '0'),
+                     FT_LOAD_NO_SCALE, &half);
+    FT_UInt  gidx;
+    FT_ULong ch = FT_Get_First_Char(sf.face, &gidx);
+    while (gidx != 0)
+    {
+      SharedFace::mark(sf.coverage, ch);
+      FT_Fixed ad;
+      if (half > 0 && FT_Get_Advance(sf.face, gidx, FT_LOAD_NO_SCALE, &ad))
+        half = 0;
+      else if (half > 0 && ad == 0)
+        SharedFace::mark(sf.zero, ch);
+      else if (half > 0 && ad != half)
+      {
+        // 半角より広い幅は1種類だけ認める
+        if (full == 0 && ad > half)
+          full = ad;
+        if (ad == full)
+          SharedFace::mark(sf.wide, ch);
+        else
+          half = 0;
+      }
+      ch = FT_Get_Next_Char(sf.face, ch, &gidx);
+    }
+    sf.mono_half = half;
+    sf.mono_full = half > 0 ? full : 0;
+    if (half == 0)
+    {
+      sf.wide.clear();
+      sf.zero.clear();
+    }
+  }
+  return sf;
+}
+
+FT_Face
+getSharedFace(int id)
+{
+  return getShared(id).face;
+}
+
+// 文字が無い時に順に探すフォント
+std::vector<int> fallback_ids;
+// 主フォントに無かった文字をどのフォントで描くか((フェイス,0,文字)→ID)
+std::unordered_map<GlyphCache::Key, int> resolved;
+
+// 文字を描くフェイスを決める(どこにも無ければ主フォントの.notdef)
+int
+resolveFace(int face_id, char32_t ch)
+{
+  if (getShared(face_id).has(ch))
+    return face_id;
+
+  auto rkey = GlyphCache::makeKey(face_id, 0, ch);
+  auto it   = resolved.find(rkey);
+  if (it != resolved.end())
+    return it->second;
+  int ret = face_id;
+  for (auto id : fallback_ids)
+  {
+    if (getShared(id).has(ch))
+    {
+      ret = id;
+      break;
+    }
+  }
+  resolved[rkey] = ret;
+  return ret;
+}
+
+//
+size_t
+getFallbackCount()
+{
+  return fallback_ids.size();
+}
+
+// 等幅フォントの半角(wideなら全角)1文字の送り幅(ピクセル, 等幅でなければ0)
+// ヒンティングと同じく整数ピクセルに丸める
+float
+monoAdvance(int face_id, int size, bool wide = false)
+{
+  auto& sf = getShared(face_id);
+  auto  ad = wide ? sf.mono_full : sf.mono_half;
+  if (sf.mono_half == 0 || ad == 0)
+    return 0.0f;
+  return std::max(std::round((float)ad * size / sf.face->units_per_EM), 1.0f);
+}
+
+// 整形するか(等幅フォントは文字毎に並べるだけにする)
+bool
+useShaping(const DrawSet& ds)
+{
+  return ds.shaping && ds.face && !FT_IS_FIXED_WIDTH(ds.face) &&
+         getShared(ds.face_id).mono_half == 0;
+}
+
+// 文字列の整形(結果はキャッシュされる)
+const Shaper::Run&
+shapeText(const DrawSet& ds, const char* msg)
+{
+  FT_Activate_Size(ds.ft_size);
+  if (ds.face->size->metrics.y_ppem != (FT_UShort)ds.height)
+    FT_Set_Pixel_Sizes(ds.face, 0, (FT_UInt)ds.height);
+  return Shaper::shape(
+      ds.face, ds.face_id, (int)ds.height, msg,
+      [&](char32_t ch) { return resolveFace(ds.face_id, ch); },
+      getSharedFace);
+}
+
+// 頂点シェーダと組み合わせてプログラムを作る
+GLuint
+createProgram(GLuint frag)
+{
+  auto prog = glCreateProgram();
+  glAttachShader(prog, vertex_shader);
+  glAttachShader(prog, frag);
+  glBindAttribLocation(prog, AttrCoord, "coord");
+  glBindAttribLocation(prog, AttrColor, "vcolor");
+  glBindAttribLocation(prog, AttrDepth, "vdepth");
+  Shader::bindOutput(prog);
+  glLinkProgram(prog);
+  glUseProgram(prog);
+  glUniform1i(glGetUniformLocation(prog, "tex"), 0);
+  glUseProgram(0);
+  return prog;
+}
+
+// キャッシュのキーに使うサイズ
+int
+glyphSize(const DrawSet& ds)
+{
+  // 距離場は1サイズだけ作って拡大縮小する
+  if (ds.sdf)
+    return GlyphCache::SDFSize | GlyphCache::SDFFlag;
+  return (int)ds.height;
+}
+
+// 先読み
+std::vector<GlyphCache::Key> prewarm_keys; // 処理待ち
+PrewarmProgress              prewarm_progress{};
+int                          prewarm_threads = 0; // 先読み前のワーカー数
+
+// 先読みの進捗更新(終わったらワーカー数を戻す)
+void
+updatePrewarm()
+{
+  if (prewarm_keys.empty())
+    return;
+  auto done = [](auto key) { return !Rasterizer::isPending(key); };
+  auto it   = std::remove_if(prewarm_keys.begin(), prewarm_keys.end(), done);
+  prewarm_progress.done += std::distance(it, prewarm_keys.end());
+  prewarm_keys.erase(it, prewarm_keys.end());
+  if (prewarm_keys.empty())
+    Rasterizer::setThreads(prewarm_threads);
+}
+
+// 文字の一覧を先読みする
+void
+prewarmCodes(WidgetPtr font, const std::vector<char32_t>& codes, bool wait)
+{
+  auto wp = std::dynamic_pointer_cast<WidgetImpl>(font);
+  if (!wp || !wp->isValid())
+    return;
+
+  auto&                        ds   = wp->getCurrent();
+  auto                         size = glyphSize(ds);
+  std::vector<GlyphCache::Key> keys;
+  keys.reserve(codes.size());
+  for (auto ch : codes)
+  {
+    auto fid  = resolveFace(ds.face_id, ch);
+    auto code = ch;
+    // 整形する場合はグリフ番号で登録される
+    if (fid == ds.face_id && useShaping(ds))
+      code = FT_Get_Char_Index(ds.face, ch) | GlyphCache::GlyphIndexFlag;
+    auto key = GlyphCache::makeKey(fid, size, code);
+    if (GlyphCache::contains(key))
+      continue;
+    GlyphCache::Glyph ng;
+    if (DiskCache::load(key, ng))
+      GlyphCache::insert(key, std::move(ng));
+    else
+      keys.push_back(key);
+  }
+  if (keys.empty())
+    return;
+
+  if (prewarm_keys.empty())
+  {
+    // 終わるまでは全コアで処理する
+    int hc           = std::thread::hardware_concurrency();
+    prewarm_threads  = Rasterizer::getThreads();
+    prewarm_progress = {};
+    Rasterizer::setThreads(std::max(hc, 1));
+  }
+  for (auto key : keys)
+  {
+    Rasterizer::request(key);
+    prewarm_keys.push_back(key);
+  }
+  prewarm_progress.total += keys.size();
+
+  while (wait && !prewarm_keys.empty())
+  {
+    Rasterizer::collect();
+    updatePrewarm();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+// ラスタライズ待ちの間の送り幅(26.6固定小数)
+// 半角は全角の2/3幅として扱う
+float
+placeholderAdvance(int size, char32_t ch)
+{
+  return (ch < 256 ? size * 2.0f / 3.0f : (float)size) * 64.0f;
+}
 } // namespace
 
 //
@@ -161,6 +617,13 @@ create(const char* fontname)
   return std::make_shared<WidgetImpl>(fontname);
 }
 
+//
+TextRunPtr
+createTextRun(const std::string& msg)
+{
+  return std::make_shared<TextRunImpl>(msg);
+}
+
 //
 //
 //
@@ -172,30 +635,31 @@ initialize()
     std::cerr << "Could not init freetype library" << std::endl;
     return false;
   }
+  Rasterizer::setupLibrary(ft);
+
+  vertex_shader   = Shader::compile(GL_VERTEX_SHADER, vertex_shader_text);
+  fragment_shader = Shader::compile(GL_FRAGMENT_SHADER, fragment_shader_text);
+  sdf_shader      = Shader::compile(GL_FRAGMENT_SHADER, sdf_shader_text);
+  program         = createProgram(fragment_shader);
+  sdf_program     = createProgram(sdf_shader);
+  vertex_array    = Shader::createVertexArray(
+      {AttrCoord, AttrColor, AttrDepth});
+  u_mvp[0]        = glGetUniformLocation(program, "MVP");
+  u_mvp[1]        = glGetUniformLocation(sdf_program, "MVP");
+  u_outline       = glGetUniformLocation(sdf_program, "outline");
+  u_outline_color = glGetUniformLocation(sdf_program, "outline_color");
+  u_shadow_offset = glGetUniformLocation(sdf_program, "shadow_offset");
+  u_shadow_color  = glGetUniformLocation(sdf_program, "shadow_color");
 
-  glGenBuffers(1, &vbo);
-  vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertex_shader, 1, &vertex_shader_text, nullptr);
-  glCompileShader(vertex_shader);
-  fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragment_shader, 1, &fragment_shader_text, nullptr);
-  glCompileShader(fragment_shader);
-  program = glCreateProgram();
-  glAttachShader(program, vertex_shader);
-  glAttachShader(program, fragment_shader);
-  glLinkProgram(program);
-  uniform_tex     = glGetUniformLocation(program, "tex");
-  uniform_color   = glGetUniformLocation(program, "color");
-  attribute_coord = glGetAttribLocation(program, "coord");
-  DEPTH           = glGetUniformLocation(program, "Depth");
-
-  glActiveTexture(GL_TEXTURE0);
-  glUniform1i(uniform_tex, 0);
+  GlyphCache::initialize();
+  Rasterizer::initialize();
 
   message_buffer.reserve(10 * 1024);
   message_buffer.resize(0);
   draw_set.reserve(1024);
   draw_set.resize(0);
+  vertex_list.reserve(6 * 10 * 1024);
+  batch_list.reserve(256);
 
   return true;
 }
@@ -206,11 +670,132 @@ initialize()
 void
 terminate()
 {
-  glDeleteBuffers(1, &vbo);
+  Shader::deleteVertexArray(vertex_array);
   glDeleteProgram(program);
+  glDeleteProgram(sdf_program);
   glDeleteShader(vertex_shader);
   glDeleteShader(fragment_shader);
-  glyphs.clear();
+  glDeleteShader(sdf_shader);
+  Rasterizer::terminate();
+  DiskCache::save();
+  DiskCache::terminate();
+  GlyphCache::terminate();
+  // フェイスとウィジェットのサイズもまとめて解放される
+  Shaper::terminate();
+  shared_faces.clear();
+  fallback_ids.clear();
+  resolved.clear();
+  FT_Done_FreeType(ft);
+  ft = nullptr;
+  FontFace::terminate();
+}
+
+//
+std::vector<AtlasInfo>
+getAtlasInfo()
+{
+  return GlyphCache::getAtlasInfo();
+}
+
+//
+void
+setCacheBudget(size_t bytes)
+{
+  GlyphCache::setBudget(bytes);
+}
+
+//
+CacheStatistics
+getCacheStatistics()
+{
+  return GlyphCache::getStatistics();
+}
+
+//
+void
+setRasterizeThreads(int threads)
+{
+  // 先読み中なら終わった後に反映する
+  if (prewarm_keys.empty())
+    Rasterizer::setThreads(threads);
+  else
+    prewarm_threads = threads;
+}
+
+//
+void
+setDiskCacheDirectory(const char* dir)
+{
+  DiskCache::setDirectory(dir);
+}
+
+//
+size_t
+saveDiskCache()
+{
+  return DiskCache::save();
+}
+
+//
+bool
+addFallbackFont(const char* fontname)
+{
+  int id = FontFace::registerFile(fontname);
+  if (id < 0 || !getSharedFace(id))
+    return false;
+  fallback_ids.push_back(id);
+  resolved.clear();
+  Shaper::clear();
+  return true;
+}
+
+//
+void
+prewarm(WidgetPtr font, const CodeRangeList& ranges, bool wait)
+{
+  std::vector<char32_t> codes;
+  for (auto& r : ranges)
+    for (char32_t ch = r.first; ch <= r.last; ch++)
+      codes.push_back(ch);
+  prewarmCodes(font, codes, wait);
+}
+
+//
+bool
+prewarm(WidgetPtr font, const char* fname, bool wait)
+{
+  std::ifstream ifs(fname, std::ios::binary);
+  if (!ifs)
+  {
+    std::cerr << "Could not open prewarm file: " << fname << std::endl;
+    return false;
+  }
+  std::string text((std::istreambuf_iterator<char>(ifs)),
+                   std::istreambuf_iterator<char>());
+
+  std::vector<char32_t> codes;
+  auto                  p = text.c_str();
+  char32_t              ch;
+  while (int r = CodeConv::U8ToU32(p, ch))
+  {
+    if (ch == '\0')
+      break;
+    p += r;
+    // 改行などの制御文字は除く
+    if (ch >= 0x20)
+      codes.push_back(ch);
+  }
+  std::sort(codes.begin(), codes.end());
+  codes.erase(std::unique(codes.begin(), codes.end()), codes.end());
+  prewarmCodes(font, codes, wait);
+  return true;
+}
+
+//
+PrewarmProgress
+getPrewarmProgress()
+{
+  return prewarm_progress;
 }
 
 //
@@ -218,43 +803,220 @@ terminate()
 //
 namespace
 {
+// キャッシュから文字を取り出す(無ければラスタライズ, ワーカー待ちならnullptr)
+const GlyphCache::Glyph*
+fetchGlyph(const DrawSet& ds, int fid, int size, char32_t code)
+{
+  auto key    = GlyphCache::makeKey(fid, size, code);
+  auto cglyph = GlyphCache::find(key);
+  if (cglyph)
+    return cglyph;
+
+  GlyphCache::Glyph ng;
+  if (DiskCache::load(key, ng))
+    return GlyphCache::insert(key, std::move(ng));
+  if (Rasterizer::getThreads() > 0)
+  {
+    Rasterizer::request(key);
+    return nullptr;
+  }
+  FT_Face face = ds.face;
+  if (fid == ds.face_id)
+    FT_Activate_Size(ds.ft_size);
+  else
+    face = getSharedFace(fid);
+  // 失敗しても空の文字を登録して、毎フレーム読み直さないようにする
+  if (!Rasterizer::rasterize(face, size, code, ng))
+    ng = GlyphCache::Glyph{};
+  return GlyphCache::insert(key, std::move(ng));
+}
+
+// 配置を追加
 void
-render(FT_Face face, const char* text, float x, float y, float sx, float sy)
+addGlyph(RunGlyphList& out, const GlyphCache::Glyph& g, float x, float y,
+         float sc)
+{
+  if (g.page < 0)
+    return;
+  RunGlyph rg;
+  rg.x1   = x + g.left * sc;
+  rg.y1   = y + g.top * sc;
+  rg.x2   = rg.x1 + g.width * sc;
+  rg.y2   = rg.y1 - g.height * sc;
+  rg.u0   = g.u0;
+  rg.v0   = g.v0;
+  rg.u1   = g.u1;
+  rg.v1   = g.v1;
+  rg.page = g.page;
+  out.push_back(rg);
+}
+
+// 文字列を原点からの配置に展開する(全ての文字が揃っていればtrue)
+// keysがあれば使った文字のキーを入れる
+bool
+layout(const DrawSet& ds, const char* msg, RunGlyphList& out, KeyList* keys)
 {
-  auto     p = text;
+  float sc       = 1.0f;
+  int   size     = glyphSize(ds);
+  bool  complete = true;
+  if (ds.sdf)
+    sc = ds.height / GlyphCache::SDFSize;
+  out.resize(0);
+  if (keys)
+    keys->resize(0);
+  if (!ds.face)
+    return true;
+
+  auto fetch = [&](int fid, char32_t code) {
+    auto g = fetchGlyph(ds, fid, size, code);
+    if (g && keys)
+      keys->push_back(GlyphCache::makeKey(fid, size, code));
+    return g;
+  };
+
+  if (useShaping(ds))
+  {
+    // 整形済みの位置に置く
+    for (auto& sg : shapeText(ds, msg).glyphs)
+    {
+      auto g = fetch(sg.face, sg.code);
+      if (g)
+        addGlyph(out, *g, sg.x, sg.y, sc);
+      else
+        complete = false;
+    }
+    return complete;
+  }
+
+  // 等幅なら位置はセル数だけで決まる(送り幅を引かない)
+  auto&    sf   = getShared(ds.face_id);
+  auto     msz  = size & ~GlyphCache::SDFFlag;
+  float    half = monoAdvance(ds.face_id, msz) * sc;
+  float    full = monoAdvance(ds.face_id, msz, true) * sc;
+  auto     p    = msg;
+  float    x    = 0.0f;
+  float    y    = 0.0f;
   char32_t ch;
+  // 表やログは同じ半角文字が多いので、この中で引いた物を覚えておく
+  // (このフレームで使った文字は追い出されない)
+  const GlyphCache::Glyph* ascii[128] = {};
   while (int r = CodeConv::U8ToU32(p, ch))
   {
     if (ch == '\0')
       break;
 
     p += r;
-    auto& mglyph = glyphs[ch];
-    if (mglyph.init == false)
+    if (half > 0.0f && ch < 128 && ascii[ch])
     {
-      if (FT_Load_Char(face, ch, FT_LOAD_RENDER))
-        continue;
-      mglyph.setup(face->glyph);
+      addGlyph(out, *ascii[ch], x, y, sc);
+      x += half;
+      continue;
+    }
+    auto fid = resolveFace(ds.face_id, ch);
+    auto g   = fetch(fid, ch);
+    if (half > 0.0f && fid == ds.face_id)
+    {
+      // ラスタライズ待ちでも後ろの文字の位置は変わらない
+      if (g)
+        addGlyph(out, *g, x, y, sc);
+      else
+        complete = false;
+      if (g && ch < 128 && sf.isHalf(ch))
+        ascii[ch] = g;
+      x += sf.monoWidth(ch, half, full);
+      continue;
+    }
+    if (!g)
+    {
+      // ワーカーに任せて、出来上がるまでは空白で送る
+      auto psize = size & ~GlyphCache::SDFFlag;
+      x += (placeholderAdvance(psize, ch) / 64) * sc;
+      complete = false;
+      continue;
+    }
+    addGlyph(out, *g, x, y, sc);
+    x += (g->ad_x / 64) * sc;
+    y += (g->ad_y / 64) * sc;
+  }
+  return complete;
+}
+
+// 配置済みの文字を頂点列に追加する
+void
+emit(const DrawSet& ds, const Decoration& deco, const RunGlyphList& glyphs,
+     float sc)
+{
+  auto& c = ds.color;
+  auto  d = ds.depth;
+  // 先にまとめて確保して、ループでは書き込むだけにする
+  GLint base = vertex_list.size();
+  vertex_list.resize(base + glyphs.size() * 6);
+  auto v = vertex_list.data() + base;
+  for (auto& g : glyphs)
+  {
+    // ページ・シェーダ・シザリング・装飾が変わる時だけ分割する
+    auto bt = batch_list.empty() ? nullptr : &batch_list.back();
+    if (!bt || bt->page != g.page || bt->sdf != ds.sdf ||
+        !bt->da.same(ds.da) || !bt->view.same(ds.view) ||
+        !bt->deco.same(deco))
+    {
+      GLint first = v - vertex_list.data();
+      batch_list.push_back({g.page, ds.sdf, ds.da, ds.view, deco, first, 0});
     }
-    else
-      mglyph.bind();
-
-    float x2 = x + mglyph.left * sx;
-    float y2 = -y - mglyph.top * sy;
-    float w  = mglyph.width * sx;
-    float h  = mglyph.height * sy;
-
-    GLfloat box[4][4] = {
-        {x2, -y2, 0, 0},
-        {x2 + w, -y2, 1, 0},
-        {x2, -y2 - h, 0, 1},
-        {x2 + w, -y2 - h, 1, 1},
-    };
-    glBufferData(GL_ARRAY_BUFFER, sizeof(box), box, GL_DYNAMIC_DRAW);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
-    x += (mglyph.ad_x / 64) * sx;
-    y += (mglyph.ad_y / 64) * sy;
+    // 文字は上が正, ピクセルは下が正
+    float x1 = ds.x + g.x1 * sc;
+    float y1 = ds.y - g.y1 * sc;
+    float x2 = ds.x + g.x2 * sc;
+    float y2 = ds.y - g.y2 * sc;
+    v[0]     = {x1, y1, g.u0, g.v0, c.r, c.g, c.b, c.a, d};
+    v[1]     = {x2, y1, g.u1, g.v0, c.r, c.g, c.b, c.a, d};
+    v[2]     = {x1, y2, g.u0, g.v1, c.r, c.g, c.b, c.a, d};
+    v[3]     = v[2];
+    v[4]     = v[1];
+    v[5]     = {x2, y2, g.u1, g.v1, c.r, c.g, c.b, c.a, d};
+    v += 6;
+    batch_list.back().count += 6;
+  }
+}
+
+// 縁取りと影をシェーダの単位(距離場の値, テクスチャ座標)にする
+// 縁取りは距離場の広がりの内側(ぼかしの1ピクセルを残す)まで
+// 影はアトラスの余白の分までで, 縁取りと合わせて文字の四角からはみ出さないようにする
+Decoration
+toUniform(const DrawSet& ds)
+{
+  Decoration u;
+  if (!ds.sdf || !ds.deco.enabled())
+    return u;
+  constexpr float ext = GlyphCache::SDFSpread - 1.0f;
+  float           sc  = GlyphCache::SDFSize / ds.height;
+  float           ol  = std::min(ds.deco.outline * sc, ext);
+  float           lim = std::min<float>(GlyphCache::SDFShadowMax, ext - ol);
+  float           ox  = std::min(std::max(ds.deco.shadow_x * sc, -lim), lim);
+  float           oy  = std::min(std::max(ds.deco.shadow_y * sc, -lim), lim);
+  u.outline       = ol / (2.0f * GlyphCache::SDFSpread);
+  u.outline_color = ds.deco.outline_color;
+  u.shadow_x      = ox / GlyphCache::AtlasSize;
+  u.shadow_y      = oy / GlyphCache::AtlasSize;
+  u.shadow_color  = ds.deco.shadow_color;
+  return u;
+}
+
+// 描画1つ分を頂点列に展開する
+void
+build(const DrawSet& ds)
+{
+  auto deco = toUniform(ds);
+  if (ds.run)
+  {
+    ds.run->update(ds);
+    emit(ds, deco, ds.run->glyphs, ds.scale);
+  }
+  else
+  {
+    layout(ds, ds.msg, scratch);
+    emit(ds, deco, scratch, ds.scale);
   }
 }
 } // namespace
@@ -262,45 +1024,99 @@ render(FT_Face face, const char* text, float x, float y, float sx, float sy)
 void
 render(GLFWwindow* window)
 {
-  // setup
-  glUseProgram(program);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
-  glEnableVertexAttribArray(attribute_coord);
-  glVertexAttribPointer(attribute_coord, 4, GL_FLOAT, GL_FALSE, 0, 0);
+  // 全文字列を1本の頂点列にまとめる
+  vertex_list.resize(0);
+  batch_list.resize(0);
+  GlyphCache::beginFrame();
+  Rasterizer::collect();
+  updatePrewarm();
+  for (auto& ds : draw_set)
+    build(ds);
+
+  stats.draw_calls   = 0;
+  stats.upload_bytes = 0;
+  stats.vertices     = vertex_list.size();
+  if (!vertex_list.empty())
+  {
+    // setup
+    auto vsize = sizeof(FontVertex) * vertex_list.size();
+    auto vr    = StreamBuffer::upload(vertex_list.data(), vsize);
+    Shader::bindAttributes(vertex_array, {AttrCoord, AttrColor, AttrDepth});
+    glBindBuffer(GL_ARRAY_BUFFER, vr.buffer);
+    stats.upload_bytes = vsize;
 
-  glEnable(GL_TEXTURE_2D);
-  glActiveTexture(GL_TEXTURE0);
+    auto stride = sizeof(FontVertex);
+    auto attr   = [&](GLuint idx, GLint n, size_t member) {
+      glVertexAttribPointer(idx, n, GL_FLOAT, GL_FALSE, stride,
+                            (const void*)(vr.offset + member));
+    };
+    attr(AttrCoord, 4, offsetof(FontVertex, x));
+    attr(AttrColor, 4, offsetof(FontVertex, r));
+    attr(AttrDepth, 1, offsetof(FontVertex, depth));
 
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glActiveTexture(GL_TEXTURE0);
 
-  // render
-  auto ws  = Graphics::getWindowSize();
-  auto bsx = 2.0 / ws.width;
-  auto bsy = 2.0 / ws.height;
-  auto da  = DrawArea{};
-  for (auto& ds : draw_set)
-  {
-    glUniform4fv(uniform_color, 1, (GLfloat*)&ds.color);
-    glUniform1f(DEPTH, ds.depth);
-    ds.da.set(da);
-    da         = ds.da;
-    float lbsx = bsx * ds.scale;
-    float lbsy = bsy * ds.scale;
-    render(ds.face, ds.msg, (float)ds.x, (float)ds.y, lbsx, lbsy);
-  }
-  Graphics::disableScissor();
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-  // cleanup
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glDisableVertexAttribArray(attribute_coord);
-  glDisable(GL_TEXTURE_2D);
-  glBindTexture(GL_TEXTURE_2D, 0);
+    // render
+    auto       da   = DrawArea{};
+    int        page = -1;
+    int        prog = -1;
+    View       view;
+    Decoration deco;
+    bool       deco_set = false;
+    for (auto& bt : batch_list)
+    {
+      if (bt.sdf != prog || !bt.view.same(view))
+      {
+        float mvp[16];
+        prog = bt.sdf;
+        view = bt.view;
+        Graphics::getProjection(mvp, view);
+        glUseProgram(bt.sdf ? sdf_program : program);
+        glUniformMatrix4fv(u_mvp[prog], 1, GL_FALSE, mvp);
+      }
+      if (bt.sdf && (!deco_set || !bt.deco.same(deco)))
+      {
+        deco     = bt.deco;
+        deco_set = true;
+        auto& oc = deco.outline_color;
+        auto& sc = deco.shadow_color;
+        glUniform1f(u_outline, deco.outline);
+        glUniform4f(u_outline_color, oc.r, oc.g, oc.b, oc.a);
+        glUniform2f(u_shadow_offset, deco.shadow_x, deco.shadow_y);
+        glUniform4f(u_shadow_color, sc.r, sc.g, sc.b, sc.a);
+      }
+      if (bt.page != page)
+      {
+        page = bt.page;
+        GlyphCache::bindPage(page);
+      }
+      bt.da.set(da);
+      da = bt.da;
+      glDrawArrays(GL_TRIANGLES, bt.first, bt.count);
+      stats.draw_calls++;
+    }
+    Graphics::disableScissor();
+
+    // cleanup
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    Shader::unbindAttributes(vertex_array, {AttrCoord, AttrColor, AttrDepth});
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
 
   message_buffer.resize(0);
   draw_set.resize(0);
 }
 
+//
+Statistics
+getStatistics()
+{
+  return stats;
+}
+
 //
 // Widget
 //
@@ -310,26 +1126,143 @@ render(GLFWwindow* window)
 //
 WidgetImpl::WidgetImpl(const char* fontname)
 {
-  if (FT_New_Face(ft, fontname, 0, &face))
-  {
-    std::cerr << "Could not open font: " << fontname << std::endl;
-    valid = false;
-    return;
-  }
-
-  valid        = true;
-  current.face = face;
-  depth        = DrawDepth;
-  scale        = 1.0;
+  int id = FontFace::registerFile(fontname);
+  if (id >= 0)
+    face = getSharedFace(id);
+  valid           = face && FT_New_Size(face, &ft_size) == 0;
+  current.face    = face;
+  current.ft_size = ft_size;
+  current.face_id = id;
+  depth           = DrawDepth;
+  scale           = 1.0;
   setSize(32, 32);
 }
 
+WidgetImpl::~WidgetImpl()
+{
+  // 終了処理の後ならライブラリと一緒に解放済み
+  if (valid && ft)
+    FT_Done_Size(ft_size);
+}
+
 void
 WidgetImpl::setSize(float w, float h)
 {
   current.width  = w;
   current.height = h;
-  FT_Set_Pixel_Sizes(face, 0, (FT_UInt)current.height);
+  advance_cache.clear();
+  measure_cache.clear();
+  if (valid)
+  {
+    applySize();
+    auto& m      = face->size->metrics;
+    line.ascent  = m.ascender / 64.0f;
+    line.descent = -m.descender / 64.0f;
+    line_height  = m.height / 64.0f;
+  }
+  else
+  {
+    line.ascent  = current.height;
+    line.descent = 0.0f;
+    line_height  = current.height;
+  }
+  auto hgt   = (int)current.height;
+  mono_half  = valid ? monoAdvance(current.face_id, hgt) : 0.0f;
+  mono_full  = valid ? monoAdvance(current.face_id, hgt, true) : 0.0f;
+  cell_width = mono_half > 0.0f ? mono_half : advance('0');
+}
+
+// フェイスは共有しているので、自分のサイズに切り替える
+// 同期ラスタライズで別サイズにされていたら戻す
+void
+WidgetImpl::applySize()
+{
+  FT_Activate_Size(ft_size);
+  if (face->size->metrics.y_ppem != (FT_UShort)current.height)
+    FT_Set_Pixel_Sizes(face, 0, (FT_UInt)current.height);
+}
+
+// 1文字の送り幅(ラスタライズはしない)
+float
+WidgetImpl::advance(char32_t ch)
+{
+  auto it = advance_cache.find(ch);
+  if (it != advance_cache.end())
+    return it->second;
+
+  float ad = placeholderAdvance((int)current.height, ch) / 64.0f;
+  if (valid)
+  {
+    auto    fid = resolveFace(current.face_id, ch);
+    FT_Face f   = face;
+    if (fid == current.face_id)
+      applySize();
+    else
+    {
+      // 代替フォントは共有のサイズを使う
+      f = getSharedFace(fid);
+      if (f->size->metrics.y_ppem != (FT_UShort)current.height)
+        FT_Set_Pixel_Sizes(f, 0, (FT_UInt)current.height);
+    }
+    // 輪郭は読まずに送り幅の表から取り、描画と同じく整数に丸める
+    FT_Fixed adv;
+    auto     gidx = FT_Get_Char_Index(f, ch);
+    if (FT_Get_Advance(f, gidx, FT_LOAD_NO_HINTING, &adv) == 0)
+      ad = std::round(adv / 65536.0f);
+    else
+      ad = 0.0f;
+  }
+  advance_cache[ch] = ad;
+  return ad;
+}
+
+Metrics
+WidgetImpl::measure(const char* msg)
+{
+  if (fallbacks != fallback_ids.size())
+  {
+    // 代替フォントが増えたら測り直す
+    advance_cache.clear();
+    measure_cache.clear();
+    fallbacks = fallback_ids.size();
+  }
+
+  Metrics ret;
+  auto    it = measure_cache.find(msg);
+  if (it != measure_cache.end())
+    ret = it->second;
+  else
+  {
+    ret       = line;
+    ret.width = 0.0f;
+    if (useShaping(current))
+      ret.width = shapeText(current, msg).width;
+    else
+    {
+      auto     p = msg;
+      char32_t ch;
+      while (int r = CodeConv::U8ToU32(p, ch))
+      {
+        if (ch == '\0')
+          break;
+        p += r;
+        // 等幅は描画と同じく半角と全角の幅で数える
+        if (mono_half > 0.0f &&
+            resolveFace(current.face_id, ch) == current.face_id)
+          ret.width += getShared(current.face_id).monoWidth(ch, mono_half,
+                                                            mono_full);
+        else
+          ret.width += advance(ch);
+      }
+    }
+    if (measure_cache.size() >= MeasureCacheMax)
+      measure_cache.clear();
+    measure_cache[msg] = ret;
+  }
+  ret.width *= scale;
+  ret.ascent *= scale;
+  ret.descent *= scale;
+  return ret;
 }
 
 void
@@ -338,8 +1271,26 @@ WidgetImpl::setColor(const Graphics::Color c)
   current.color = c;
 }
 
+namespace
+{
+// 表示位置(-1〜1, 上が正)をウィンドウのピクセルにする
+Graphics::Locate
+toPixel(float x, float y)
+{
+  auto ws = Graphics::getWindowSize();
+  return {(x + 1.0) * ws.width * 0.5, (1.0 - y) * ws.height * 0.5};
+}
+} // namespace
+
 void
 WidgetImpl::print(const char* msg, float x, float y)
+{
+  auto pos = toPixel(x, y);
+  printPixel(msg, pos.x, pos.y);
+}
+
+void
+WidgetImpl::printPixel(const char* msg, double x, double y)
 {
   int  l = std::strlen(msg);
   auto p = message_buffer.size();
@@ -352,8 +1303,36 @@ WidgetImpl::print(const char* msg, float x, float y)
   nds.depth = depth;
   nds.msg   = &message_buffer[p];
   nds.da    = da;
+  nds.view  = Graphics::getView();
   nds.scale = scale;
+  // 縁取り・影は距離場で描く
+  if (nds.deco.enabled())
+    nds.sdf = true;
   draw_set.emplace_back(nds);
 }
 
+void
+WidgetImpl::print(const TextRunPtr& text, float x, float y)
+{
+  auto pos = toPixel(x, y);
+  printPixel(text, pos.x, pos.y);
+}
+
+void
+WidgetImpl::printPixel(const TextRunPtr& text, double x, double y)
+{
+  auto nds  = current;
+  nds.x     = x;
+  nds.y     = y;
+  nds.depth = depth;
+  nds.da    = da;
+  nds.view  = Graphics::getView();
+  nds.scale = scale;
+  // 縁取り・影は距離場で描く
+  if (nds.deco.enabled())
+    nds.sdf = true;
+  nds.run   = std::static_pointer_cast<TextRunImpl>(text);
+  draw_set.emplace_back(std::move(nds));
+}
+
 } // namespace FontDraw
@@ -3,36 +3,140 @@
 
 #include "gl_def.h"
 #include <memory>
+#include <string>
+#include <vector>
 
 struct GLFWwindow;
 
 namespace FontDraw
 {
+// 文字列の寸法(ピクセル, スケール込み)
+struct Metrics
+{
+  float width;   // 送り幅の合計
+  float ascent;  // ベースラインから上
+  float descent; // ベースラインから下
+};
+
+// 配置を保持する文字列
+// 文字列かフォントが変わった時だけ組み直すので、毎フレーム同じ文字列を描く時に使う
+class TextRun
+{
+public:
+  virtual ~TextRun() = default;
+
+  virtual void               set(const std::string& msg) = 0;
+  virtual const std::string& get() const                 = 0;
+};
+using TextRunPtr = std::shared_ptr<TextRun>;
+TextRunPtr createTextRun(const std::string& msg = "");
+
 // フォント1つ分の管理
 class Widget
 {
 public:
   virtual ~Widget() = default;
 
-  virtual void  setSize(float w, float h)                           = 0;
-  virtual void  setColor(const Graphics::Color)                     = 0;
-  virtual void  setScale(float s)                                   = 0;
-  virtual void  print(const char* msg, float x, float y)            = 0;
-  virtual void  setDepth(float d)                                   = 0;
-  virtual void  pushDepth(float d)                                  = 0;
-  virtual void  popDepth()                                          = 0;
-  virtual void  setDrawArea(double x, double y, double w, double h) = 0;
-  virtual void  clearDrawArea()                                     = 0;
-  virtual float getSizeX() const                                    = 0;
-  virtual float getSizeY() const                                    = 0;
-  virtual float getScale() const                                    = 0;
+  virtual void    setSize(float w, float h)                            = 0;
+  virtual void    setColor(const Graphics::Color)                      = 0;
+  virtual void    setScale(float s)                                    = 0;
+  virtual void    setSDF(bool s)                                       = 0;
+  virtual void    setShaping(bool s)                                   = 0;
+  virtual void    setOutline(float w, const Graphics::Color c)         = 0;
+  virtual void    setShadow(float x, float y, const Graphics::Color c) = 0;
+  virtual void    print(const char* msg, float x, float y)             = 0;
+  virtual void    print(const TextRunPtr& text, float x, float y)      = 0;
+  // ウィンドウのピクセル座標(左上原点)で表示
+  virtual void    printPixel(const char* msg, double x, double y)      = 0;
+  virtual void    printPixel(const TextRunPtr& t, double x, double y)  = 0;
+  virtual void    setDepth(float d)                                    = 0;
+  virtual void    pushDepth(float d)                                   = 0;
+  virtual void    popDepth()                                           = 0;
+  virtual void    setDrawArea(double x, double y, double w, double h)  = 0;
+  virtual void    clearDrawArea()                                      = 0;
+  virtual Metrics measure(const char* msg)                             = 0;
+  virtual float   getSizeX() const                                     = 0;
+  virtual float   getSizeY() const                                     = 0;
+  virtual float   getScale() const                                     = 0;
+  // 等幅フォントとして文字毎に並べているか
+  virtual bool    isMonospace() const                                  = 0;
 };
 using WidgetPtr = std::shared_ptr<Widget>;
 WidgetPtr create(const char* fontname);
 
+// 文字アトラスページの使用状況
+struct AtlasInfo
+{
+  int    width;
+  int    height;
+  int    glyphs;
+  double fill; // 使用率(0.0-1.0)
+};
+
+// 直前のフレームの描画統計
+struct Statistics
+{
+  size_t draw_calls;   // glDrawArrays呼び出し回数
+  size_t upload_bytes; // 頂点の転送量
+  size_t vertices;     // 頂点数
+};
+
+// 文字キャッシュの統計
+struct CacheStatistics
+{
+  size_t hits;      // キャッシュヒット数
+  size_t misses;    // キャッシュミス数
+  size_t evictions; // 追い出した数
+  size_t entries;   // 登録数
+  size_t bytes;     // 使用メモリ
+  size_t budget;    // メモリ上限
+};
+
+// 先読みする文字の範囲(両端を含む)
+struct CodeRange
+{
+  char32_t first;
+  char32_t last;
+};
+using CodeRangeList = std::vector<CodeRange>;
+constexpr CodeRange RangeASCII{0x20, 0x7e};
+constexpr CodeRange RangeCJKSymbol{0x3000, 0x303f}; // 句読点・括弧など
+constexpr CodeRange RangeKana{0x3040, 0x30ff};      // ひらがな・カタカナ
+constexpr CodeRange RangeFullWidth{0xff00, 0xffef}; // 全角英数・半角カナ
+
+// 先読みの進捗
+struct PrewarmProgress
+{
+  size_t done;  // 処理済み
+  size_t total; // 要求した数
+};
+
 //
 bool initialize();
 void render(GLFWwindow*);
 void terminate();
+//
+std::vector<AtlasInfo> getAtlasInfo();
+//
+Statistics getStatistics();
+// 文字キャッシュのメモリ上限(バイト)
+void setCacheBudget(size_t bytes);
+//
+CacheStatistics getCacheStatistics();
+// 文字ラスタライズのワーカー数(0で描画スレッドで同期処理)
+void setRasterizeThreads(int threads);
+// 文字キャッシュファイルの置き場所(nullptrで無効, 終了時に保存する)
+void setDiskCacheDirectory(const char* dir);
+// 文字キャッシュファイルの保存
+size_t saveDiskCache();
+// 文字が無い時に使う代替フォントを追加する(追加した順に探す)
+bool addFallbackFont(const char* fontname);
+// 指定フォントの現在のサイズで文字を先にラスタライズする
+// 処理中は全コアを使い、waitがfalseなら描画の間に裏で進める
+void prewarm(WidgetPtr font, const CodeRangeList& ranges, bool wait = false);
+// ファイル(UTF-8)に含まれる文字を先読みする(漢字の一覧など)
+bool prewarm(WidgetPtr font, const char* fname, bool wait = false);
+//
+PrewarmProgress getPrewarmProgress();
 
 } // namespace FontDraw
@@ -0,0 +1,108 @@
+#include "fontface.h"
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//
+// フォントファイルはプロセスで1度だけマップして
+// 各スレッドのFT_LibraryからFT_New_Memory_Faceで共有する
+//
+namespace FontFace
+{
+namespace
+{
+namespace fs = std::filesystem;
+
+// フォントファイル1つ分
+struct Entry
+{
+  std::string        name;
+  MapFile::HandlePtr file;
+};
+std::vector<Entry>         entries;
+std::map<std::string, int> name_ids;
+std::mutex                 entry_mutex;
+
+// 同じファイルを別の書き方で指定しても同じものになるように
+std::string
+canonicalName(const char* fname)
+{
+  std::error_code ec;
+  auto            p = fs::weakly_canonical(fs::path(fname), ec);
+  return ec ? std::string(fname) : p.string();
+}
+
+} // namespace
+
+//
+int
+registerFile(const char* fname)
+{
+  auto                        name = canonicalName(fname);
+  std::lock_guard<std::mutex> lock(entry_mutex);
+  auto                        it = name_ids.find(name);
+  if (it != name_ids.end())
+    return it->second;
+
+  auto file = MapFile::open(fname);
+  if (!file)
+  {
+    std::cerr << "Could not open font: " << fname << std::endl;
+    return -1;
+  }
+  int id         = entries.size();
+  name_ids[name] = id;
+  entries.push_back({name, file});
+  return id;
+}
+
+//
+MapFile::HandlePtr
+getFile(int id)
+{
+  std::lock_guard<std::mutex> lock(entry_mutex);
+  if (id < 0 || id >= (int)entries.size())
+    return MapFile::HandlePtr();
+  return entries[id].file;
+}
+
+//
+std::string
+getName(int id)
+{
+  std::lock_guard<std::mutex> lock(entry_mutex);
+  if (id < 0 || id >= (int)entries.size())
+    return std::string();
+  return entries[id].name;
+}
+
+//
+FT_Face
+openFace(FT_Library library, int id)
+{
+  auto file = getFile(id);
+  if (!file)
+    return nullptr;
+
+  FT_Face face = nullptr;
+  if (FT_New_Memory_Face(library, file->data(), file->size(), 0, &face))
+  {
+    std::cerr << "Could not open font face: " << id << std::endl;
+    return nullptr;
+  }
+  return face;
+}
+
+//
+void
+terminate()
+{
+  std::lock_guard<std::mutex> lock(entry_mutex);
+  entries.clear();
+  name_ids.clear();
+}
+
+} // namespace FontFace
@@ -0,0 +1,23 @@
+// font face registry
+#pragma once
+
+#include "mapfile.h"
+#include <string>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+namespace FontFace
+{
+// フォントファイルを登録してIDを返す(失敗したら-1)
+// 同じファイルは1度だけマップして同じIDを返す
+int registerFile(const char* fname);
+// マップしたフォントファイル
+MapFile::HandlePtr getFile(int id);
+// 登録したファイル名(正規化済み, 無ければ空)
+std::string getName(int id);
+// マップしたメモリからフェイスを作る(FT_Library毎に呼ぶ)
+FT_Face openFace(FT_Library library, int id);
+//
+void terminate();
+
+} // namespace FontFace
@@ -28,6 +28,8 @@ WindowSize     base_size{};
 bool           now_fullscreen = false;
 bool           enable_event   = true;
 bool           pulldown_mode  = false;
+DrawArea       scissor_area{}; // 現在のシザリング
+View           view{};         // 現在のビュー変換
 
 // キーコードからintへの変換
 int
@@ -401,6 +403,7 @@ setupFrame()
   glfwGetFramebufferSize(window, &w, &h);
   window_size.width  = w;
   window_size.height = h;
+  view               = View{};
 
   if (pulldown_mode)
   {
@@ -459,6 +462,36 @@ getWindowSize()
   return window_size;
 }
 
+//
+void
+setView(const View& v)
+{
+  view = v;
+}
+
+//
+View
+getView()
+{
+  return view;
+}
+
+//
+void
+getProjection(float* mat, const View& v)
+{
+  auto sx = 2.0 / window_size.width;
+  auto sy = 2.0 / window_size.height;
+  for (int i = 0; i < 16; i++)
+    mat[i] = 0.0f;
+  mat[0]  = sx * v.scale;
+  mat[5]  = -sy * v.scale;
+  mat[10] = 1.0f;
+  mat[12] = v.ox * sx - 1.0;
+  mat[13] = 1.0 - v.oy * sy;
+  mat[15] = 1.0f;
+}
+
 //
 Locate
 getMousePosition()
@@ -486,11 +519,18 @@ enableScissor(double x, double y, double w, double h)
 {
   glEnable(GL_SCISSOR_TEST);
   glScissor(x + 1, window_size.height - y - h + 1, w - 1, h - 1);
+  scissor_area = DrawArea{x, y, w, h, true};
 }
 void
 disableScissor()
 {
   glDisable(GL_SCISSOR_TEST);
+  scissor_area.e = false;
+}
+DrawArea
+getScissor()
+{
+  return scissor_area;
 }
 
 //
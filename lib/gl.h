@@ -31,9 +31,21 @@ struct DrawArea
   double h = 0.0;
   bool   e = false;
 
+  inline bool same(const DrawArea& o) const;
   inline void set(const DrawArea& old) const;
 };
 
+// ピクセル座標(左上原点)の表示位置・倍率(スクロール・拡大用)
+// (x,y)は(x * scale + ox, y * scale + oy)に表示する
+struct View
+{
+  double ox    = 0.0;
+  double oy    = 0.0;
+  double scale = 1.0;
+
+  inline bool same(const View& o) const;
+};
+
 //
 bool        initialize(const char* appname, int w, int h);
 GLFWwindow* setupFrame();
@@ -53,6 +65,12 @@ const char* getClipboardString();
 void        switchFullScreen();
 void        enableScissor(double x, double y, double w, double h);
 void        disableScissor();
+DrawArea    getScissor();
+void        setView(const View&); // setupFrameで元に戻る
+View        getView();
+// ピクセル座標からクリップ座標への変換(列優先4x4, 深度はそのまま)
+// Primitive2D・FontDraw・Texture2Dはこれを共通で使う
+void        getProjection(float* mat, const View& view);
 KeyInput&   getKeyInput();
 void        enableEvent();
 void        disableEvent(OffEventCallback);
@@ -62,17 +80,33 @@ void        closePulldown();
 Locate      getPulldownCursor();
 Vector      getScroll();
 
+//
+bool
+DrawArea::same(const DrawArea& o) const
+{
+  if (e != o.e)
+    return false;
+  return !e || (x == o.x && y == o.y && w == o.w && h == o.h);
+}
+
 //
 void
 DrawArea::set(const DrawArea& old) const
 {
   if (e)
   {
-    if (old.e == false || x != old.x || y != old.y || w != old.w || h != old.h)
+    if (!same(old))
       Graphics::enableScissor(x, y, w, h);
   }
   else if (old.e)
     Graphics::disableScissor();
 }
 
+//
+bool
+View::same(const View& o) const
+{
+  return ox == o.ox && oy == o.oy && scale == o.scale;
+}
+
 } // namespace Graphics
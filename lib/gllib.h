@@ -13,6 +13,7 @@
 #include "scrollbox.h"
 #include "sheet.h"
 #include "slidebar.h"
+#include "streambuffer.h"
 #include "textbox.h"
 #include "textbutton.h"
 #include "texture2d.h"
@@ -28,6 +29,7 @@ initialize(const char* appname, const char* fontname, int w, int h)
   if (!Graphics::initialize(appname, w, h))
     return FontDraw::WidgetPtr();
 
+  StreamBuffer::initialize();
   FontDraw::initialize();
   auto font = FontDraw::create(fontname);
 
@@ -55,6 +57,7 @@ terminate()
   Texture2D::terminate();
   FontDraw::terminate();
   Primitive2D::terminate();
+  StreamBuffer::terminate();
   Graphics::terminate();
 }
 
@@ -82,10 +85,13 @@ update(Func func)
   if (!window)
     return false;
 
+  StreamBuffer::beginFrame();
   Primitive2D::setup(window);
   DrawBox::setup();
 
   auto ret = func();
+  // ウィジェットはアプリのビュー(スクロール・拡大)の影響を受けない
+  Graphics::setView(Graphics::View{});
 
   ScrollBox::update();
   Sheet::update();
@@ -102,6 +108,7 @@ update(Func func)
   Primitive2D::cleanup();
   Texture2D::update();
   FontDraw::render(window);
+  StreamBuffer::endFrame();
   Graphics::cleanupFrame();
 
   return ret;
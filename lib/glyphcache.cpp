@@ -0,0 +1,407 @@
+#include "glyphcache.h"
+#include "gl.h"
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+namespace GlyphCache
+{
+namespace
+{
+// 文字テクスチャアトラス(1ページ分)
+// 棚(shelf)詰めで文字を配置し、追い出された領域は空きリストで再利用する
+struct AtlasPage
+{
+  static constexpr int Size       = AtlasSize;
+  static constexpr int Padding    = 1;
+  static constexpr int SDFPadding = Padding + SDFShadowMax; // 影の分も空ける
+
+  struct Shelf
+  {
+    int y;
+    int height;
+    int x;
+  };
+  struct Rect
+  {
+    int x, y, w, h;
+  };
+  std::vector<Shelf> shelves;
+  std::vector<Rect>  free_list;
+  GLuint             tex    = 0;
+  int                bottom = 0;
+  size_t             used   = 0;
+  int                count  = 0;
+
+  AtlasPage()
+  {
+    std::vector<uint8_t> zero(Size * Size, 0);
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, Size, Size, 0, GL_RED,
+                 GL_UNSIGNED_BYTE, zero.data());
+  }
+  ~AtlasPage() { glDeleteTextures(1, &tex); }
+
+  // 領域確保(入らなければfalse)
+  // 返す座標はパディングを含んだ左上
+  bool alloc(int pw, int ph, int& ox, int& oy)
+  {
+    // 空きリストから一番小さく収まるものを探す
+    Rect* fit = nullptr;
+    for (auto& r : free_list)
+    {
+      if (r.w < pw || r.h < ph)
+        continue;
+      if (!fit || r.w * r.h < fit->w * fit->h)
+        fit = &r;
+    }
+    if (fit)
+    {
+      auto r = *fit;
+      *fit   = free_list.back();
+      free_list.pop_back();
+      // 余った部分を分割して戻す
+      if (r.w > pw)
+        free_list.push_back({r.x + pw, r.y, r.w - pw, ph});
+      if (r.h > ph)
+        free_list.push_back({r.x, r.y + ph, r.w, r.h - ph});
+      ox = r.x;
+      oy = r.y;
+    }
+    else
+    {
+      // 高さの無駄が一番少ない棚を探す
+      Shelf* best = nullptr;
+      for (auto& sh : shelves)
+      {
+        if (sh.height < ph || sh.x + pw > Size)
+          continue;
+        if (!best || sh.height < best->height)
+          best = &sh;
+      }
+      // 無駄が大きすぎる場合は新しい棚を作る
+      if (best && best->height > ph * 2 && bottom + ph <= Size)
+        best = nullptr;
+      if (!best)
+      {
+        if (bottom + ph > Size || pw > Size)
+          return false;
+        shelves.push_back({bottom, ph, 0});
+        bottom += ph;
+        best = &shelves.back();
+      }
+      ox = best->x;
+      oy = best->y;
+      best->x += pw;
+    }
+    used += pw * ph;
+    count++;
+    return true;
+  }
+
+  // 領域解放
+  void release(int x, int y, int pw, int ph)
+  {
+    used -= pw * ph;
+    count--;
+    if (count == 0)
+    {
+      // 空になったらページごと初期化
+      shelves.clear();
+      free_list.clear();
+      bottom = 0;
+      used   = 0;
+      return;
+    }
+    free_list.push_back({x, y, pw, ph});
+  }
+
+  void upload(int x, int y, int w, int h, const uint8_t* buffer)
+  {
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RED, GL_UNSIGNED_BYTE,
+                    buffer);
+  }
+
+  void bind() { glBindTexture(GL_TEXTURE_2D, tex); }
+
+  double fill() const { return (double)used / (Size * Size); }
+};
+std::vector<std::unique_ptr<AtlasPage>> atlas;
+
+// キャッシュエントリ
+struct Entry
+{
+  Glyph                    glyph;
+  std::list<Key>::iterator lru;
+  size_t                   cost  = 0;
+  uint32_t                 frame = 0;
+};
+std::unordered_map<Key, Entry> glyphs;
+std::list<Key>                 lru_list;
+std::vector<uint8_t>           padded;
+
+constexpr size_t          DefaultBudget = 16 * 1024 * 1024;
+size_t                    budget        = DefaultBudget;
+uint32_t                  frame_count   = 1;
+uint32_t                  generation    = 0;
+FontDraw::CacheStatistics stats{};
+
+// 文字の周りの余白
+int
+padding(Key key)
+{
+  bool sdf = (keySize(key) & SDFFlag) != 0;
+  return sdf ? AtlasPage::SDFPadding : AtlasPage::Padding;
+}
+
+// パディング込みのサイズ
+int
+paddedSize(int s, int pad)
+{
+  return s + pad * 2;
+}
+
+// アトラスへ配置
+void
+place(Glyph& g, int pad)
+{
+  if (g.buffer.empty())
+    return;
+
+  int pw = paddedSize(g.width, pad);
+  int ph = paddedSize(g.height, pad);
+  int x, y;
+  int page = -1;
+  for (int i = atlas.size() - 1; i >= 0; i--)
+  {
+    if (atlas[i]->alloc(pw, ph, x, y))
+    {
+      page = i;
+      break;
+    }
+  }
+  if (page < 0)
+  {
+    atlas.emplace_back(std::make_unique<AtlasPage>());
+    if (!atlas.back()->alloc(pw, ph, x, y))
+      return;
+    page = atlas.size() - 1;
+  }
+
+  // 周囲を0で埋めて転送(再利用した領域のゴミを消す)
+  padded.assign(pw * ph, 0);
+  for (int i = 0; i < g.height; i++)
+  {
+    auto src = &g.buffer[i * g.width];
+    auto dst = &padded[(i + pad) * pw + pad];
+    std::copy(src, src + g.width, dst);
+  }
+  atlas[page]->upload(x, y, pw, ph, padded.data());
+
+  auto s = 1.0f / AtlasPage::Size;
+  g.page = page;
+  g.u0   = (x + pad) * s;
+  g.v0   = (y + pad) * s;
+  g.u1   = (x + pad + g.width) * s;
+  g.v1   = (y + pad + g.height) * s;
+}
+
+// アトラスから解放
+void
+remove(const Glyph& g, int pad)
+{
+  if (g.page < 0)
+    return;
+  auto s  = (float)AtlasPage::Size;
+  int  x  = (int)(g.u0 * s + 0.5f) - pad;
+  int  y  = (int)(g.v0 * s + 0.5f) - pad;
+  int  pw = paddedSize(g.width, pad);
+  int  ph = paddedSize(g.height, pad);
+  atlas[g.page]->release(x, y, pw, ph);
+}
+
+// 上限を超えた分を古い順に追い出す
+void
+evict()
+{
+  while (stats.bytes > budget && !lru_list.empty())
+  {
+    auto key = lru_list.back();
+    auto it  = glyphs.find(key);
+    // このフレームで使っている文字は追い出さない
+    if (it->second.frame == frame_count)
+      break;
+    remove(it->second.glyph, padding(key));
+    stats.bytes -= it->second.cost;
+    stats.evictions++;
+    generation++;
+    lru_list.pop_back();
+    glyphs.erase(it);
+  }
+  stats.entries = glyphs.size();
+}
+
+} // namespace
+
+//
+void
+initialize()
+{
+  glyphs.reserve(4096);
+  stats        = {};
+  stats.budget = budget;
+}
+
+//
+void
+terminate()
+{
+  glyphs.clear();
+  lru_list.clear();
+  atlas.clear();
+  generation++;
+  stats.bytes   = 0;
+  stats.entries = 0;
+}
+
+//
+void
+beginFrame()
+{
+  frame_count++;
+}
+
+//
+const Glyph*
+find(Key key)
+{
+  auto it = glyphs.find(key);
+  if (it == glyphs.end())
+  {
+    stats.misses++;
+    return nullptr;
+  }
+  auto& e = it->second;
+  if (e.lru != lru_list.begin())
+    lru_list.splice(lru_list.begin(), lru_list, e.lru);
+  e.frame = frame_count;
+  stats.hits++;
+  return &e.glyph;
+}
+
+//
+void
+touch(Key key)
+{
+  auto it = glyphs.find(key);
+  if (it == glyphs.end())
+    return;
+  auto& e = it->second;
+  if (e.lru != lru_list.begin())
+    lru_list.splice(lru_list.begin(), lru_list, e.lru);
+  e.frame = frame_count;
+}
+
+//
+bool
+contains(Key key)
+{
+  return glyphs.count(key) > 0;
+}
+
+//
+const Glyph*
+insert(Key key, Glyph&& glyph)
+{
+  auto& e = glyphs[key];
+  if (e.cost > 0)
+  {
+    // 上書き
+    remove(e.glyph, padding(key));
+    generation++;
+    stats.bytes -= e.cost;
+    lru_list.erase(e.lru);
+  }
+  e.glyph = std::move(glyph);
+  auto pad = padding(key);
+  place(e.glyph, pad);
+  e.cost = sizeof(Entry) + e.glyph.buffer.size();
+  if (e.glyph.page >= 0)
+  {
+    auto pw = paddedSize(e.glyph.width, pad);
+    auto ph = paddedSize(e.glyph.height, pad);
+    e.cost += pw * ph;
+  }
+  e.frame = frame_count;
+  e.lru   = lru_list.insert(lru_list.begin(), key);
+  stats.bytes += e.cost;
+  evict();
+  return &e.glyph;
+}
+
+//
+void
+forEach(const std::function<void(Key, const Glyph&)>& func)
+{
+  for (auto& g : glyphs)
+    func(g.first, g.second.glyph);
+}
+
+//
+void
+bindPage(int page)
+{
+  atlas[page]->bind();
+}
+
+//
+void
+setBudget(size_t bytes)
+{
+  budget       = bytes;
+  stats.budget = bytes;
+  evict();
+}
+
+//
+uint32_t
+getGeneration()
+{
+  return generation;
+}
+
+//
+FontDraw::CacheStatistics
+getStatistics()
+{
+  return stats;
+}
+
+//
+std::vector<FontDraw::AtlasInfo>
+getAtlasInfo()
+{
+  std::vector<FontDraw::AtlasInfo> ret;
+  ret.reserve(atlas.size());
+  for (auto& pg : atlas)
+  {
+    FontDraw::AtlasInfo ai;
+    ai.width  = AtlasPage::Size;
+    ai.height = AtlasPage::Size;
+    ai.glyphs = pg->count;
+    ai.fill   = pg->fill();
+    ret.push_back(ai);
+  }
+  return ret;
+}
+
+} // namespace GlyphCache
@@ -0,0 +1,89 @@
+// glyph cache utility
+#pragma once
+
+#include "font.h"
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace GlyphCache
+{
+// (フェイス,ピクセルサイズ,コードポイント)をまとめたキー
+using Key = uint64_t;
+// 距離場(SDF)の文字はサイズにこのフラグを立てる
+constexpr int SDFFlag = 0x8000;
+// 距離場の文字は全てこのサイズでラスタライズする
+constexpr int SDFSize = 48;
+// 距離場の広がり(ピクセル)
+constexpr int SDFSpread = 8;
+// 距離場の文字の影のずらし量の上限(SDFSizeでのピクセル)
+// アトラスではこの分だけ余白を広げて隣の文字を拾わないようにする
+constexpr int SDFShadowMax = 4;
+// アトラス1ページの大きさ
+constexpr int AtlasSize = 1024;
+// 整形した文字はコードポイントの代わりにグリフ番号にこのフラグを立てる
+constexpr char32_t GlyphIndexFlag = 0x80000000;
+inline Key
+makeKey(int face, int size, char32_t code)
+{
+  return ((Key)(face & 0xffff) << 48) | ((Key)(size & 0xffff) << 32) |
+         (Key)code;
+}
+inline int
+keyFace(Key key)
+{
+  return (int)((key >> 48) & 0xffff);
+}
+inline int
+keySize(Key key)
+{
+  return (int)((key >> 32) & 0xffff);
+}
+inline char32_t
+keyCode(Key key)
+{
+  return (char32_t)(key & 0xffffffff);
+}
+
+// 文字1つ分
+struct Glyph
+{
+  std::vector<uint8_t> buffer;
+  int                  width  = 0;
+  int                  height = 0;
+  float                left   = 0.0f;
+  float                top    = 0.0f;
+  float                ad_x   = 0.0f; // 26.6固定小数
+  float                ad_y   = 0.0f; // 26.6固定小数
+  int                  page   = -1;
+  float                u0 = 0.0f, v0 = 0.0f, u1 = 0.0f, v1 = 0.0f;
+};
+
+//
+void initialize();
+//
+void terminate();
+// フレーム開始(このフレームで使用した文字は追い出さない)
+void beginFrame();
+// キャッシュ検索(無ければnullptr)
+const Glyph* find(Key key);
+// 登録されているか(統計とLRUには影響しない)
+bool contains(Key key);
+// このフレームで使った印を付ける(検索せずに使い続ける文字用, 統計には影響しない)
+void touch(Key key);
+// ラスタライズ済みの文字を登録する
+const Glyph* insert(Key key, Glyph&& glyph);
+// 登録されている全ての文字
+void forEach(const std::function<void(Key, const Glyph&)>& func);
+// アトラスページのバインド
+void bindPage(int page);
+// メモリ上限(バイト)
+void setBudget(size_t bytes);
+// 登録済みの文字の配置が無効になる(追い出し・上書き)度に増える
+uint32_t getGeneration();
+//
+FontDraw::CacheStatistics getStatistics();
+//
+std::vector<FontDraw::AtlasInfo> getAtlasInfo();
+
+} // namespace GlyphCache
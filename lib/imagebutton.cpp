@@ -128,9 +128,8 @@ ButtonImpl::draw(bool focus)
     auto fsy = font->getSizeY() * scale;
     auto cx  = (loc.x + btm.x - caption.length() * fsx) * 0.5;
     auto cy  = btm.y + fsy;
-    auto pos = Graphics::calcLocate(cx, cy);
     font->setScale(scale);
-    font->print(caption.c_str(), pos.x, pos.y);
+    font->printPixel(caption.c_str(), cx, cy);
     font->setScale(fsc);
   }
 
@@ -1,6 +1,5 @@
 #include "label.h"
 #include "bb.h"
-#include "codeconv.h"
 #include "gl.h"
 #include "layer.h"
 #include "primitive2d.h"
@@ -22,13 +21,13 @@ FontDraw::WidgetPtr font;
 struct Item : public Base
 {
   ~Item() = default;
-  std::string  label;
-  double       length;
-  Color        fgcol;
-  Color        bgcol;
-  SlideBar::ID slider;
-  int          sl_prec;
-  double       sl_num;
+  FontDraw::TextRunPtr label = FontDraw::createTextRun();
+  double               length;
+  Color                fgcol;
+  Color                bgcol;
+  SlideBar::ID         slider;
+  int                  sl_prec;
+  double               sl_num;
 
   void setText(std::string l) override;
   void setFontColor(Graphics::Color col) override { fgcol = col; }
@@ -81,10 +80,10 @@ Item::draw()
   auto loc = bbox.getLocate();
   auto btm = bbox.getBottom();
   if (bgcol.a > 0.0)
-    Primitive2D::drawBox(loc.x, loc.y, btm.x, btm.y, bgcol, true);
+    Primitive2D::drawRect(loc.x, loc.y, btm.x, btm.y, bgcol,
+                          Graphics::ClearColor);
   font->setColor(fgcol);
-  auto pos = Graphics::calcLocate(loc.x + 20, loc.y + 42);
-  font->print(label.c_str(), pos.x, pos.y);
+  font->printPixel(label, loc.x + 20, loc.y + 42);
   Graphics::disableScissor();
   font->clearDrawArea();
 }
@@ -93,11 +92,11 @@ Item::draw()
 void
 Item::setText(std::string str)
 {
-  double l  = CodeConv::U8Length2(str.c_str()) * 21.0;
+  double l  = font->measure(str.c_str()).width;
   auto   rx = x + l + 20 + 20;
   auto   by = y + 20 + 32 + 10;
 
-  label  = str;
+  label->set(str);
   length = l;
   initGeometry(x, y, rx - x, by - y);
 }
@@ -0,0 +1,100 @@
+#include "mapfile.h"
+#if defined(_MSC_VER)
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace MapFile
+{
+namespace
+{
+//
+class HandleImpl : public Handle
+{
+public:
+#if defined(_MSC_VER)
+  HANDLE file    = INVALID_HANDLE_VALUE;
+  HANDLE mapping = nullptr;
+#else
+  int fd = -1;
+#endif
+  const uint8_t* ptr = nullptr;
+  size_t         len = 0;
+
+  ~HandleImpl() override { close(); }
+
+  const uint8_t* data() const override { return ptr; }
+  size_t         size() const override { return len; }
+
+  bool open(const char* fname)
+  {
+#if defined(_MSC_VER)
+    file = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+      return false;
+    LARGE_INTEGER fsize;
+    if (!GetFileSizeEx(file, &fsize) || fsize.QuadPart == 0)
+      return false;
+    len     = (size_t)fsize.QuadPart;
+    mapping = CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+      return false;
+    ptr = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    return ptr != nullptr;
+#else
+    fd = ::open(fname, O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+      return false;
+    len    = (size_t)st.st_size;
+    auto p = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED)
+      return false;
+    ptr = (const uint8_t*)p;
+    return true;
+#endif
+  }
+
+  void close()
+  {
+#if defined(_MSC_VER)
+    if (ptr)
+      UnmapViewOfFile(ptr);
+    if (mapping)
+      CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE)
+      CloseHandle(file);
+    mapping = nullptr;
+    file    = INVALID_HANDLE_VALUE;
+#else
+    if (ptr)
+      munmap((void*)ptr, len);
+    if (fd >= 0)
+      ::close(fd);
+    fd = -1;
+#endif
+    ptr = nullptr;
+    len = 0;
+  }
+};
+
+} // namespace
+
+//
+HandlePtr
+open(const char* fname)
+{
+  auto h = std::make_shared<HandleImpl>();
+  if (!h->open(fname))
+    return HandlePtr{};
+  return h;
+}
+
+} // namespace MapFile
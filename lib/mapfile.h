@@ -0,0 +1,24 @@
+// memory mapped file utility
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace MapFile
+{
+// 読み込み専用でマップしたファイル
+class Handle
+{
+public:
+  virtual ~Handle() = default;
+
+  virtual const uint8_t* data() const = 0;
+  virtual size_t         size() const = 0;
+};
+using HandlePtr = std::shared_ptr<Handle>;
+
+// ファイルをマップする(失敗したら空)
+HandlePtr open(const char* fname);
+
+} // namespace MapFile
@@ -1,5 +1,4 @@
 #include "notification.h"
-#include "codeconv.h"
 #include "font.h"
 #include "gl.h"
 #include "primitive2d.h"
@@ -50,7 +49,7 @@ struct MsgImpl : public Msg
     double tw = icon >= 0 ? w_rate * font->getSizeY() + 20.0 : 0.0;
     disp_y += (tgt_y - disp_y) * 0.05;
     auto ws = Graphics::getWindowSize();
-    auto l  = CodeConv::U8Length2(message.c_str()) * font->getSizeX() + tw;
+    auto l  = font->measure(message.c_str()).width + tw;
     auto x  = ws.width - (l + 130.0);
     auto rx = ws.width - 10.0;
     auto y  = disp_y + 5.0;
@@ -79,8 +78,7 @@ struct MsgImpl : public Msg
       Texture2D::draw(dset);
     }
     font->setColor(font_col);
-    auto loc = Graphics::calcLocate(x + tw + 60, y + 48);
-    font->print(message.c_str(), loc.x, loc.y);
+    font->printPixel(message.c_str(), x + tw + 60, y + 48);
     return tgt_y + 80.0;
   }
 };
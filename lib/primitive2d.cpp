@@ -2,36 +2,231 @@
 // ↑windowsでのdefineの都合上、一番先頭に置く
 #include "linmath.h"
 #include "primitive2d.h"
+#include "shader.h"
+#include "streambuffer.h"
+#include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstddef>
 #include <iostream>
+#include <map>
 
 namespace Primitive2D
 {
 //
 namespace
 {
-const char* vt_sh = "#version 110\n"
-                    "uniform mat4 MVP;\n"
+// シェーダ本体(バージョン毎の違いは先頭に付けるマクロで吸収する)
+const char* vt_sh = "uniform mat4 MVP;\n"
+                    "uniform vec4 Tint;\n"
                     "attribute vec4 vCol;\n"
-                    "attribute vec2 vPos;\n"
-                    "uniform float Depth;\n"
+                    "attribute vec3 vPos;\n"
                     "varying vec4 color;\n"
                     "void main() {\n"
-                    "    gl_Position = MVP * vec4(vPos, Depth, 1.0);\n"
-                    "    color = vCol;\n"
+                    "    gl_Position = MVP * vec4(vPos, 1.0);\n"
+                    "    color = vCol * Tint;\n"
                     "}\n";
-const char* fg_sh = "#version 110\n"
-                    "varying vec4 color;\n"
+const char* fg_sh = "varying vec4 color;\n"
                     "void main() {\n"
                     "    gl_FragColor = color;\n"
                     "}\n";
+// 3.0未満のコンテキストで使うバージョン
+const char* legacy_version = "#version 110\n";
+// 矩形(3.3以降のみ): 枠は辺からの距離で塗り分ける
+const char* rect_vt_sh = "uniform mat4 MVP;\n"
+                         "uniform float Pixel;\n"
+                         "in vec2 vPos;\n"
+                         "in vec4 vRect;\n"
+                         "in vec4 vFill;\n"
+                         "in vec4 vBorder;\n"
+                         "in vec2 vParam;\n"
+                         "out vec2 local;\n"
+                         "flat out vec2 size;\n"
+                         "flat out vec4 fill;\n"
+                         "flat out vec4 border;\n"
+                         "flat out float width;\n"
+                         "void main() {\n"
+                         "    vec2 p = vRect.xy + vPos * vRect.zw;\n"
+                         "    gl_Position = MVP * vec4(p, vParam.y, 1.0);\n"
+                         "    size   = vRect.zw / Pixel;\n"
+                         "    local  = vPos * size;\n"
+                         "    fill   = vFill;\n"
+                         "    border = vBorder;\n"
+                         "    width  = vParam.x;\n"
+                         "}\n";
+const char* rect_fg_sh =
+    "in vec2 local;\n"
+    "flat in vec2 size;\n"
+    "flat in vec4 fill;\n"
+    "flat in vec4 border;\n"
+    "flat in float width;\n"
+    "void main() {\n"
+    "    vec2  e = min(local, size - local);\n"
+    "    float d = min(e.x, e.y);\n"
+    "    float t = width > 0.0 ? clamp(width - d + 0.5, 0.0, 1.0) : 0.0;\n"
+    "    vec4  c = mix(fill, border, t);\n"
+    "    if (c.a <= 0.0)\n"
+    "        discard;\n"
+    "    frag_color = c;\n"
+    "}\n";
+
+// 頂点属性の位置
+enum Attribute : GLuint
+{
+  AttrPos,
+  AttrCol,
+  // 矩形のインスタンス毎
+  AttrRect = 1,
+  AttrFill,
+  AttrBorder,
+  AttrParam,
+};
+
+// 転送する頂点(深度は頂点毎に持つ)
+struct DrawVertex
+{
+  float x, y, z;
+  float r, g, b, a;
+};
+
+// 矩形1つ分
+struct RectInstance
+{
+  float x, y, w, h; // 左下と大きさ
+  Color fill;
+  Color border;
+  float width; // 枠の太さ(ピクセル)
+  float depth;
+};
 
 GLuint     vertex_shader, fragment_shader, program;
-GLuint     vertex_buffer[1];
-GLint      MVP, vpos, vcol, DEPTH;
-float      DrawDepth = 0.05f, SaveDepth = 0.0f;
-VertexList box_vertex;
+GLuint     vertex_array = 0; // コアプロファイル用(使えなければ0)
+GLint      MVP, TINT;
+GLuint     rect_vertex_shader, rect_fragment_shader, rect_program;
+GLuint     rect_corner;      // 矩形の角4つ
+GLuint     rect_array = 0;   // インスタンス描画用(使えなければ0)
+GLint      RECT_MVP, RECT_PIXEL;
+float      DrawDepth = 0.05f;
+float      pixel_size = 0.0f;  // 1ピクセルの大きさ(溜めている座標系の単位)
+bool       use_pixel  = false; // setPixelSpaceの指定
+Statistics stats{};
+
+// 座標系(ウィンドウのピクセルかグラフィック座標か, ビュー変換)
+struct Space
+{
+  bool           pixel = false;
+  Graphics::View view{};
+
+  bool same(const Space& o) const
+  {
+    return pixel == o.pixel && view.same(o.view);
+  }
+};
+
+// 描画待ちの三角形(線も太さ分の四角形にして溜める)
+// 深度は頂点・インスタンス毎に持つので、シザリング・座標系が変わるまで1回で描く
+// 描く順番を保つため、三角形と矩形はどちらか一方だけ溜める
+struct Batch
+{
+  std::vector<DrawVertex>   vertex;
+  std::vector<GLuint>       index;
+  std::vector<RectInstance> rect;
+  Graphics::DrawArea        da{};
+  Space                     space{};
+};
+Batch              batch;
+std::vector<float> depth_stack;       // pushDepthで退避した深度
+bool               recording = false; // createMeshで溜めている
+
+// 座標系からクリップ座標への変換(Graphicsのピクセル座標の変換を元にする)
+void
+calcMVP(mat4x4 mvp, const Space& sp)
+{
+  Graphics::getProjection((float*)mvp, sp.view);
+  if (sp.pixel)
+    return;
+  // グラフィック座標(縦-1〜1, 左右は縦横比で伸ばす)からピクセルへ
+  auto   ws = Graphics::getWindowSize();
+  float  hh = ws.height * 0.5f;
+  mat4x4 g;
+  mat4x4_identity(g);
+  g[0][0] = hh;
+  g[1][1] = -hh;
+  g[3][0] = ws.width * 0.5f;
+  g[3][1] = hh;
+  mat4x4_mul(mvp, mvp, g);
+}
+
+// 座標系での1ピクセルの大きさ
+float
+unitPixel(const Space& sp)
+{
+  float u = sp.pixel ? 1.0f : 2.0f / Graphics::getWindowSize().height;
+  return u / sp.view.scale;
+}
+
+// 頂点属性の設定(転送先が毎回変わるので描画毎)
+void
+setAttributes(const StreamBuffer::Range& r)
+{
+  glBindBuffer(GL_ARRAY_BUFFER, r.buffer);
+  glVertexAttribPointer(AttrPos, 3, GL_FLOAT, GL_FALSE, sizeof(DrawVertex),
+                        (const void*)(r.offset + offsetof(DrawVertex, x)));
+  glVertexAttribPointer(AttrCol, 4, GL_FLOAT, GL_FALSE, sizeof(DrawVertex),
+                        (const void*)(r.offset + offsetof(DrawVertex, r)));
+}
+
+// 矩形のインスタンス毎の属性
+void
+setRectAttributes(const StreamBuffer::Range& r)
+{
+  auto attr = [&](GLuint idx, GLint n, size_t member) {
+    glVertexAttribPointer(idx, n, GL_FLOAT, GL_FALSE, sizeof(RectInstance),
+                          (const void*)(r.offset + member));
+  };
+  glBindBuffer(GL_ARRAY_BUFFER, r.buffer);
+  attr(AttrRect, 4, offsetof(RectInstance, x));
+  attr(AttrFill, 4, offsetof(RectInstance, fill));
+  attr(AttrBorder, 4, offsetof(RectInstance, border));
+  attr(AttrParam, 2, offsetof(RectInstance, width));
+}
+
+// インスタンス描画の準備(角4つを共有して矩形毎の属性を進める)
+void
+initializeRect()
+{
+#if defined(GL_VERSION_3_3)
+  rect_vertex_shader   = Shader::compile(GL_VERTEX_SHADER, rect_vt_sh);
+  rect_fragment_shader = Shader::compile(GL_FRAGMENT_SHADER, rect_fg_sh);
+  rect_program         = glCreateProgram();
+  glAttachShader(rect_program, rect_vertex_shader);
+  glAttachShader(rect_program, rect_fragment_shader);
+  glBindAttribLocation(rect_program, AttrPos, "vPos");
+  glBindAttribLocation(rect_program, AttrRect, "vRect");
+  glBindAttribLocation(rect_program, AttrFill, "vFill");
+  glBindAttribLocation(rect_program, AttrBorder, "vBorder");
+  glBindAttribLocation(rect_program, AttrParam, "vParam");
+  glLinkProgram(rect_program);
+  RECT_MVP   = glGetUniformLocation(rect_program, "MVP");
+  RECT_PIXEL = glGetUniformLocation(rect_program, "Pixel");
+
+  static const GLfloat corner[] = {0, 0, 1, 0, 0, 1, 1, 1};
+  glGenBuffers(1, &rect_corner);
+  glGenVertexArrays(1, &rect_array);
+  glBindVertexArray(rect_array);
+  glBindBuffer(GL_ARRAY_BUFFER, rect_corner);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(corner), corner, GL_STATIC_DRAW);
+  glEnableVertexAttribArray(AttrPos);
+  glVertexAttribPointer(AttrPos, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+  for (GLuint idx : {AttrRect, AttrFill, AttrBorder, AttrParam})
+  {
+    glEnableVertexAttribArray(idx);
+    glVertexAttribDivisor(idx, 1);
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+#endif
+}
 
 } // namespace
 
@@ -42,25 +237,22 @@ void
 initialize()
 {
   // シェーダ生成
-  vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertex_shader, 1, &vt_sh, nullptr);
-  glCompileShader(vertex_shader);
-  fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragment_shader, 1, &fg_sh, nullptr);
-  glCompileShader(fragment_shader);
-  program = glCreateProgram();
+  vertex_shader   = Shader::compile(GL_VERTEX_SHADER, vt_sh, legacy_version);
+  fragment_shader = Shader::compile(GL_FRAGMENT_SHADER, fg_sh, legacy_version);
+  program         = glCreateProgram();
   glAttachShader(program, vertex_shader);
   glAttachShader(program, fragment_shader);
+  glBindAttribLocation(program, AttrPos, "vPos");
+  glBindAttribLocation(program, AttrCol, "vCol");
+  Shader::bindOutput(program);
   glLinkProgram(program);
-  MVP   = glGetUniformLocation(program, "MVP");
-  vpos  = glGetAttribLocation(program, "vPos");
-  vcol  = glGetAttribLocation(program, "vCol");
-  DEPTH = glGetUniformLocation(program, "Depth");
-
-  // 頂点生成
-  glGenBuffers(1, vertex_buffer);
+  MVP  = glGetUniformLocation(program, "MVP");
+  TINT = glGetUniformLocation(program, "Tint");
 
-  box_vertex.resize(5);
+  // 頂点はStreamBufferに書き込む
+  vertex_array = Shader::createVertexArray({AttrPos, AttrCol});
+  if (Shader::getVersion() >= 33)
+    initializeRect();
 }
 
 //
@@ -69,7 +261,18 @@ initialize()
 void
 terminate()
 {
-  glDeleteBuffers(1, vertex_buffer);
+  Shader::deleteVertexArray(vertex_array);
+#if defined(GL_VERSION_3_0)
+  if (rect_array)
+  {
+    glDeleteVertexArrays(1, &rect_array);
+    glDeleteBuffers(1, &rect_corner);
+    glDeleteProgram(rect_program);
+    glDeleteShader(rect_vertex_shader);
+    glDeleteShader(rect_fragment_shader);
+  }
+  rect_array = 0;
+#endif
   glDeleteProgram(program);
   glDeleteShader(vertex_shader);
   glDeleteShader(fragment_shader);
@@ -81,22 +284,14 @@ terminate()
 void
 setup(GLFWwindow* window)
 {
-  auto ws    = Graphics::getWindowSize();
-  auto ratio = ws.width / ws.height;
-
-  mat4x4 mvp;
-  mat4x4_ortho(mvp, -ratio, ratio, -1.f, 1.f, 1.f, -1.f);
-
   glUseProgram(program);
-  glUniformMatrix4fv(MVP, 1, GL_FALSE, (const GLfloat*)mvp);
-  glUniform1f(DEPTH, DrawDepth);
-  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer[0]);
-  glEnableVertexAttribArray(vpos);
-  glVertexAttribPointer(vpos, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                        &((Vertex*)0)->x);
-  glEnableVertexAttribArray(vcol);
-  glVertexAttribPointer(vcol, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                        &((Vertex*)0)->r);
+  glUniform4fv(TINT, 1, (const GLfloat*)&Graphics::White);
+  stats = Statistics{};
+  depth_stack.resize(0);
+  batch.vertex.resize(0);
+  batch.index.resize(0);
+  batch.rect.resize(0);
+  Shader::bindAttributes(vertex_array, {AttrPos, AttrCol});
 
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -108,33 +303,40 @@ setup(GLFWwindow* window)
 void
 cleanup()
 {
+  flush();
+  Shader::unbindAttributes(vertex_array, {AttrPos, AttrCol});
   glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glDisableVertexAttribArray(vpos);
-  glDisableVertexAttribArray(vcol);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+//
+void
+setPixelSpace(bool pixel)
+{
+  use_pixel = pixel;
 }
 
 //
 void
 setDepth(float d)
 {
-  if (d != DrawDepth)
-  {
-    DrawDepth = d;
-    glUniform1f(DEPTH, DrawDepth);
-  }
+  DrawDepth = d;
 }
 
 //
 void
 pushDepth(float d)
 {
-  SaveDepth = DrawDepth;
+  depth_stack.push_back(DrawDepth);
   setDepth(d);
 }
 void
 popDepth()
 {
-  setDepth(SaveDepth);
+  if (depth_stack.empty())
+    return;
+  setDepth(depth_stack.back());
+  depth_stack.pop_back();
 }
 
 //
@@ -142,88 +344,938 @@ popDepth()
 //
 namespace
 {
+// 溜まっている矩形を描く(終わったら三角形用の状態に戻す)
 void
-draw(const VertexList& vlist, GLenum p)
+drawRects()
 {
-  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer[0]);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vlist.size(), vlist.data(),
-               GL_STATIC_DRAW);
-  glDrawArrays(p, 0, vlist.size());
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+#if defined(GL_VERSION_3_3)
+  auto& rl    = batch.rect;
+  auto  rsize = sizeof(RectInstance) * rl.size();
+  auto  r     = StreamBuffer::upload(rl.data(), rsize);
+  mat4x4 mvp;
+  calcMVP(mvp, batch.space);
+  glUseProgram(rect_program);
+  glUniformMatrix4fv(RECT_MVP, 1, GL_FALSE, (const GLfloat*)mvp);
+  glUniform1f(RECT_PIXEL, unitPixel(batch.space));
+  glBindVertexArray(rect_array);
+  setRectAttributes(r);
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, rl.size());
+  glBindVertexArray(vertex_array);
+  glUseProgram(program);
+
+  stats.upload_bytes += rsize;
+  stats.vertices += rl.size() * 4;
+  rl.resize(0);
+#endif
+}
+
+// 溜まっている三角形か矩形を描く
+void
+draw()
+{
+  auto& vl = batch.vertex;
+  auto& il = batch.index;
+  if (recording || (il.empty() && batch.rect.empty()))
+    return;
+
+  // シザリングは溜めた時の物にして、描いたら戻す
+  auto da = Graphics::getScissor();
+  batch.da.set(da);
+  if (!batch.rect.empty())
+    drawRects();
+  else
+  {
+    auto vsize = sizeof(DrawVertex) * vl.size();
+    auto isize = sizeof(GLuint) * il.size();
+    auto vr    = StreamBuffer::upload(vl.data(), vsize);
+    auto ir    = StreamBuffer::upload(il.data(), isize);
+    mat4x4 mvp;
+    calcMVP(mvp, batch.space);
+    glUniformMatrix4fv(MVP, 1, GL_FALSE, (const GLfloat*)mvp);
+    setAttributes(vr);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ir.buffer);
+    glDrawElements(GL_TRIANGLES, il.size(), GL_UNSIGNED_INT,
+                   (const void*)ir.offset);
+    stats.upload_bytes += vsize + isize;
+    stats.vertices += vl.size();
+    vl.resize(0);
+    il.resize(0);
+  }
+  da.set(batch.da);
+  stats.flushes++;
+}
+
+// 状態が変わっていたら描いてから、追加できるようにする
+// (メッシュ作成中は座標系を変えない)
+Batch&
+append(bool rect = false, bool pixel = use_pixel)
+{
+  auto  da = Graphics::getScissor();
+  Space sp{pixel, Graphics::getView()};
+  if (recording)
+    sp = batch.space;
+  else if (!batch.index.empty() || !batch.rect.empty())
+  {
+    size_t* reason = nullptr;
+    if (batch.rect.empty() == rect)
+      reason = &stats.by_kind;
+    else if (!batch.da.same(da))
+      reason = &stats.by_scissor;
+    else if (!batch.space.same(sp))
+      reason = &stats.by_space;
+    if (reason)
+    {
+      (*reason)++;
+      draw();
+    }
+  }
+  batch.da    = da;
+  batch.space = sp;
+  pixel_size  = unitPixel(sp);
+  return batch;
+}
+
+// 矩形の座標をピクセルから溜めている座標系にする
+Vertex
+boxVertex(double x, double y, const Color& c)
+{
+  if (batch.space.pixel)
+    return {(float)x, (float)y, c.r, c.g, c.b, c.a};
+  auto loc = Graphics::calcLocate(x, y, true);
+  return {(float)loc.x, (float)loc.y, c.r, c.g, c.b, c.a};
+}
+
+// 頂点を現在の深度で追加
+void
+addVertex(Batch& bt, const Vertex& v)
+{
+  bt.vertex.push_back({v.x, v.y, DrawDepth, v.r, v.g, v.b, v.a});
+}
+
+// 四角形(頂点4つ)を三角形2つで追加
+void
+addQuad(Batch& bt, const Vertex& v0, const Vertex& v1, const Vertex& v2,
+        const Vertex& v3)
+{
+  GLuint i = bt.vertex.size();
+  for (auto v : {&v0, &v1, &v2, &v3})
+    addVertex(bt, *v);
+  bt.index.insert(bt.index.end(), {i, i + 1, i + 2, i, i + 2, i + 3});
+}
+
+// 線分を太さ分の四角形にする(wはピクセル)
+void
+addSegment(Batch& bt, const Vertex& a, const Vertex& b, float w)
+{
+  float dx  = b.x - a.x;
+  float dy  = b.y - a.y;
+  float len = std::sqrt(dx * dx + dy * dy);
+  if (len <= 0.0f)
+    return;
+  // 線に垂直な方向に太さの半分ずつ広げる
+  float  hw = w * 0.5f * pixel_size / len;
+  float  nx = -dy * hw;
+  float  ny = dx * hw;
+  Vertex v0 = a, v1 = b, v2 = b, v3 = a;
+  v0.x += nx;
+  v0.y += ny;
+  v1.x += nx;
+  v1.y += ny;
+  v2.x -= nx;
+  v2.y -= ny;
+  v3.x -= nx;
+  v3.y -= ny;
+  addQuad(bt, v0, v1, v2, v3);
+}
+
+//
+// 円
+//
+constexpr int MinSegments = 8;
+constexpr int MaxSegments = 256;
+
+// 単位円上の点
+struct UnitPoint
+{
+  float x, y;
+};
+using UnitPointList = std::vector<UnitPoint>;
+// 分割数毎の単位円(1度作ったら使い回す)
+std::map<int, UnitPointList> circle_table;
+UnitPointList                arc_points; // 円弧用の作業領域
+
+// 画面上の半径から分割数を決める(弦と円弧の差が1/4ピクセル以下)
+int
+segments(float rad, int num)
+{
+  if (num > 0)
+    return std::max(num, 3);
+  float r = pixel_size > 0.0f ? std::abs(rad) / pixel_size : 0.0f;
+  if (r <= 1.0f)
+    return MinSegments;
+  int n = (int)std::ceil(M_PI / std::acos(1.0f - 0.25f / r));
+  // 4の倍数にまとめて表を共有しやすくする
+  n = (n + 3) & ~3;
+  return std::min(std::max(n, MinSegments), MaxSegments);
+}
+
+// 単位円(偶数分割は半分ずらして上下左右対称にする)
+const UnitPointList&
+unitCircle(int num)
+{
+  auto& tbl = circle_table[num];
+  if (tbl.empty())
+  {
+    float ofs = num & 1 ? 0.0f : 0.5f;
+    tbl.resize(num);
+    for (int i = 0; i < num; i++)
+    {
+      auto r = 2.0 * M_PI * (ofs + i) / num;
+      tbl[i] = {(float)std::sin(r), (float)std::cos(r)};
+    }
+  }
+  return tbl;
+}
+
+// 円弧上の点(三角関数は刻み幅の分だけ)
+const UnitPointList&
+unitArc(float start, float end, int num)
+{
+  float span = end - start;
+  int   n    = std::max((int)std::ceil(num * std::abs(span) / (2.0 * M_PI)), 1);
+  float cs   = std::cos(span / n);
+  float sn   = std::sin(span / n);
+  float x    = std::cos(start);
+  float y    = std::sin(start);
+  arc_points.resize(n + 1);
+  for (auto& p : arc_points)
+  {
+    p       = {x, y};
+    float t = x * cs - y * sn;
+    y       = x * sn + y * cs;
+    x       = t;
+  }
+  return arc_points;
+}
+
+// 点列に沿って太さwピクセルの帯を作る(閉じていれば最後と最初を繋ぐ)
+void
+addRing(Batch& bt, const Vertex& c, float rad, float w,
+        const UnitPointList& pts, bool closed)
+{
+  float  hw  = w * 0.5f * pixel_size;
+  float  ro  = rad + hw;
+  float  ri  = std::max(rad - hw, 0.0f);
+  GLuint top = bt.vertex.size();
+  GLuint n   = pts.size();
+  for (auto& p : pts)
+  {
+    auto vo = c;
+    auto vi = c;
+    vo.x += p.x * ro;
+    vo.y += p.y * ro;
+    vi.x += p.x * ri;
+    vi.y += p.y * ri;
+    addVertex(bt, vo);
+    addVertex(bt, vi);
+  }
+  GLuint segs = closed ? n : n - 1;
+  for (GLuint i = 0; i < segs; i++)
+  {
+    GLuint a = top + i * 2;
+    GLuint b = top + ((i + 1) % n) * 2;
+    bt.index.insert(bt.index.end(), {a, b, a + 1, a + 1, b, b + 1});
+  }
+}
+
+// 中心から点列への扇形
+void
+addFan(Batch& bt, const Vertex& c, float rad, const UnitPointList& pts,
+       bool closed)
+{
+  GLuint top = bt.vertex.size();
+  GLuint n   = pts.size();
+  addVertex(bt, c);
+  for (auto& p : pts)
+  {
+    auto v = c;
+    v.x += p.x * rad;
+    v.y += p.y * rad;
+    addVertex(bt, v);
+  }
+  GLuint segs = closed ? n : n - 1;
+  for (GLuint i = 0; i < segs; i++)
+    bt.index.insert(bt.index.end(), {top, top + 1 + i, top + 1 + (i + 1) % n});
+}
+
+//
+// 線(繋ぎ目・端・破線)
+//
+// 点をずらした物
+Vertex
+shift(const Vertex& v, float x, float y)
+{
+  auto ret = v;
+  ret.x += x;
+  ret.y += y;
+  return ret;
+}
+
+// 2点の間(色も補間する)
+Vertex
+lerp(const Vertex& a, const Vertex& b, float t)
+{
+  return {a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t,
+          a.r + (b.r - a.r) * t, a.g + (b.g - a.g) * t,
+          a.b + (b.b - a.b) * t, a.a + (b.a - a.a) * t};
+}
+
+// 点を順に受け取って太さのある線にする
+// 線分毎に四角形を置き、曲がった外側に繋ぎ目を足す
+class Stroker
+{
+  Batch&           bt;
+  const LineStyle& style;
+  float            hw;      // 太さの半分
+  float            min_len; // これより短い移動は間引く
+  float            min_m2;  // マイターにする|na+nb|^2の下限
+  int              round;   // 丸の1周分の分割数
+  bool             closed  = false;
+  bool             pending = false; // 間引いた点があるか
+  int              count   = 0;     // 線分の数
+  Vertex           first, last, skip;
+  float            fx = 0.0f, fy = 0.0f; // 最初の線分の向き
+  float            dx = 0.0f, dy = 0.0f; // 直前の線分の向き
+  GLuint           first_quad = 0;       // 最初の線分の頂点番号
+  GLuint           last_quad  = 0;       // 直前の線分の頂点番号
+
+  void segment(const Vertex& v, float ux, float uy, float len);
+  void join(const Vertex& p, float ax, float ay, float bx, float by,
+            GLuint qa, GLuint qb);
+  void cap(const Vertex& p, float ox, float oy);
+
+public:
+  Stroker(Batch& b, const LineStyle& s);
+
+  void reserve(size_t num);
+  void begin(const Vertex& v, bool c = false);
+  void lineTo(const Vertex& v);
+  void end();
+};
+
+//
+Stroker::Stroker(Batch& b, const LineStyle& s) : bt(b), style(s)
+{
+  hw        = std::max(s.width, 0.0f) * 0.5f * pixel_size;
+  min_len   = pixel_size * 0.25f;
+  float lim = std::max(s.miter_limit, 1.0f);
+  min_m2    = 4.0f / (lim * lim);
+  round     = segments(hw, 0);
+}
+
+// num点の線に要る分(四角形・繋ぎ目・両端)をまとめて確保する
+// 破線の切れ目に付く端の分は含まない
+void
+Stroker::reserve(size_t num)
+{
+  // 丸は半周以下なので分割数もround/2+1まで
+  size_t arc = round / 2 + 1;
+  size_t jv = 0, ji = 6, cv = 0, ci = 0;
+  switch (style.join)
+  {
+  case LineJoin::Round:
+    jv = arc + 2;
+    ji = arc * 3;
+    break;
+  case LineJoin::Miter:
+    jv = 1;
+    ji = 9;
+    break;
+  default:
+    break;
+  }
+  switch (style.cap)
+  {
+  case LineCap::Square:
+    cv = 4;
+    ci = 6;
+    break;
+  case LineCap::Round:
+    cv = arc + 2;
+    ci = arc * 3;
+    break;
+  default:
+    break;
+  }
+  bt.vertex.reserve(bt.vertex.size() + num * (4 + jv) + cv * 2);
+  bt.index.reserve(bt.index.size() + num * (6 + ji) + ci * 2);
+}
+
+//
+void
+Stroker::begin(const Vertex& v, bool c)
+{
+  closed  = c;
+  pending = false;
+  count   = 0;
+  first   = v;
+  last    = v;
+}
+
+//
+void
+Stroker::lineTo(const Vertex& v)
+{
+  float ux = v.x - last.x;
+  float uy = v.y - last.y;
+  float l2 = ux * ux + uy * uy;
+  if (l2 < min_len * min_len)
+  {
+    skip    = v;
+    pending = true;
+    return;
+  }
+  pending = false;
+  segment(v, ux, uy, std::sqrt(l2));
+}
+
+//
+void
+Stroker::end()
+{
+  auto to = [this](const Vertex& v) {
+    float ux  = v.x - last.x;
+    float uy  = v.y - last.y;
+    float len = std::sqrt(ux * ux + uy * uy);
+    if (len > 0.0f)
+      segment(v, ux, uy, len);
+  };
+  if (closed && count > 0)
+  {
+    to(first);
+    join(first, dx, dy, fx, fy, last_quad, first_quad);
+    return;
+  }
+  if (pending)
+    to(skip);
+  pending = false;
+  if (count > 0)
+    cap(last, dx, dy);
+  else
+  {
+    // 長さが無ければ端だけ(破線の点)
+    cap(last, 1.0f, 0.0f);
+    cap(last, -1.0f, 0.0f);
+  }
+}
+
+// (ux,uy)は長さlenの向き
+void
+Stroker::segment(const Vertex& v, float ux, float uy, float len)
+{
+  ux /= len;
+  uy /= len;
+  float  nx   = -uy * hw;
+  float  ny   = ux * hw;
+  GLuint quad = bt.vertex.size();
+  addQuad(bt, shift(last, nx, ny), shift(v, nx, ny), shift(v, -nx, -ny),
+          shift(last, -nx, -ny));
+  if (count == 0)
+  {
+    fx         = ux;
+    fy         = uy;
+    first_quad = quad;
+    if (!closed)
+      cap(last, -ux, -uy);
+  }
+  else
+    join(last, dx, dy, ux, uy, last_quad, quad);
+
+  dx        = ux;
+  dy        = uy;
+  last      = v;
+  last_quad = quad;
+  count++;
+}
+
+// 向き(ax,ay)から(bx,by)へ曲がる所
+// qa, qbは前後の線分の四角形(左始点, 左終点, 右終点, 右始点)の先頭
+void
+Stroker::join(const Vertex& p, float ax, float ay, float bx, float by,
+              GLuint qa, GLuint qb)
+{
+  float cross = ax * by - ay * bx;
+  float dot   = ax * bx + ay * by;
+  if (std::abs(cross) < 1e-6f && dot > 0.0f)
+    return;
+  if (style.join == LineJoin::Round)
+  {
+    // 左に曲がれば右側が外になる
+    float s     = cross > 0.0f ? -hw : hw;
+    float start = std::atan2(ax * s, -ay * s);
+    float turn  = std::atan2(cross, dot);
+    addFan(bt, p, hw, unitArc(start, start + turn, round), false);
+    return;
+  }
+
+  // 前の終端と次の始端の4頂点で隙間を埋める(内側は重なる)
+  GLuint a0 = qa + 1, a1 = qa + 2, b0 = qb, b1 = qb + 3;
+  bt.index.insert(bt.index.end(), {a0, b0, a1, a0, a1, b1});
+  if (style.join != LineJoin::Miter)
+    return;
+  float mx = -ay - by;
+  float my = ax + bx;
+  float m2 = mx * mx + my * my;
+  if (m2 < min_m2 || m2 <= 0.0f)
+    return;
+  float  s   = cross > 0.0f ? -hw : hw;
+  float  k   = 2.0f * s / m2;
+  GLuint tip = bt.vertex.size();
+  addVertex(bt, shift(p, mx * k, my * k));
+  if (s > 0.0f)
+    bt.index.insert(bt.index.end(), {a0, tip, b0});
+  else
+    bt.index.insert(bt.index.end(), {a1, tip, b1});
+}
+
+// (ox,oy)は外向き
+void
+Stroker::cap(const Vertex& p, float ox, float oy)
+{
+  float nx = -oy * hw;
+  float ny = ox * hw;
+  switch (style.cap)
+  {
+  case LineCap::Square:
+  {
+    float ex = ox * hw;
+    float ey = oy * hw;
+    addQuad(bt, shift(p, nx, ny), shift(p, nx + ex, ny + ey),
+            shift(p, ex - nx, ey - ny), shift(p, -nx, -ny));
+    break;
+  }
+  case LineCap::Round:
+  {
+    float start = std::atan2(ny, nx);
+    addFan(bt, p, hw, unitArc(start, start - (float)M_PI, round), false);
+    break;
+  }
+  default:
+    break;
+  }
 }
 } // namespace
 
+//
+void
+flush()
+{
+  if (recording)
+    return;
+  if (!batch.index.empty() || !batch.rect.empty())
+    stats.by_flush++;
+  draw();
+}
+
+//
+Statistics
+getStatistics()
+{
+  return stats;
+}
+
 void
 drawLine(const VertexList& vlist, float w)
 {
-  glLineWidth(w);
-  draw(vlist, GL_LINE_STRIP);
+  auto& bt = append();
+  for (size_t i = 1; i < vlist.size(); i++)
+    addSegment(bt, vlist[i - 1], vlist[i], w);
+}
+
+void
+drawPath(const Vertex* vtx, size_t num, const LineStyle& style, bool closed)
+{
+  if (num == 0)
+    return;
+  auto&   bt = append();
+  Stroker st{bt, style};
+  st.reserve(num);
+
+  float total = 0.0f;
+  for (auto d : style.dash)
+    total += std::max(d, 0.0f);
+  if (total <= 0.0f)
+  {
+    st.begin(vtx[0], closed && num > 2);
+    for (size_t i = 1; i < num; i++)
+      st.lineTo(vtx[i]);
+    st.end();
+    return;
+  }
+
+  // 破線: 長さを測りながら描く所と空ける所を切り替える
+  auto   dlen = [&](size_t i) { return std::max(style.dash[i], 0.0f); };
+  auto   dn   = style.dash.size();
+  size_t di   = 0;
+  bool   on   = true;
+  float  ofs  = std::fmod(style.dash_offset, total);
+  float  left = dlen(0);
+  if (ofs < 0.0f)
+    ofs += total;
+  while (ofs >= left)
+  {
+    ofs -= left;
+    di   = (di + 1) % dn;
+    on   = !on;
+    left = dlen(di);
+  }
+  left = (left - ofs) * pixel_size;
+
+  if (on)
+    st.begin(vtx[0]);
+  auto last = closed ? num + 1 : num;
+  for (size_t i = 1; i < last; i++)
+  {
+    auto& a   = vtx[i - 1];
+    auto& b   = vtx[i % num];
+    float sx  = b.x - a.x;
+    float sy  = b.y - a.y;
+    float len = std::sqrt(sx * sx + sy * sy);
+    float t   = 0.0f;
+    while (len - t > left)
+    {
+      t += left;
+      auto v = lerp(a, b, t / len);
+      if (on)
+      {
+        st.lineTo(v);
+        st.end();
+      }
+      else
+        st.begin(v);
+      di   = (di + 1) % dn;
+      on   = !on;
+      left = dlen(di) * pixel_size;
+    }
+    left -= len - t;
+    if (on)
+      st.lineTo(b);
+  }
+  if (on)
+    st.end();
 }
 
 void
 drawQuads(const VertexList& vlist)
 {
-  draw(vlist, GL_QUADS);
+  auto& bt = append();
+  for (size_t i = 0; i + 3 < vlist.size(); i += 4)
+    addQuad(bt, vlist[i], vlist[i + 1], vlist[i + 2], vlist[i + 3]);
 }
 
 void
 drawTriangles(const VertexList& vlist)
 {
-  draw(vlist, GL_TRIANGLES);
+  auto&  bt = append();
+  GLuint i  = bt.vertex.size();
+  auto   n  = vlist.size() - vlist.size() % 3;
+  for (GLuint j = 0; j < n; j++)
+  {
+    addVertex(bt, vlist[j]);
+    bt.index.push_back(i + j);
+  }
 }
 
 void
 drawCircle(const Vertex& vtx, float rad, int num, float w)
 {
-  VertexList vlist;
-  vlist.resize(num);
-  float ofs = num & 1 ? 0.0f : 0.5f;
-  for (int i = 0; i < num; i++)
+  // 分割数は追加先の座標系のピクセルの大きさで決める
+  auto& bt  = append();
+  auto& tbl = unitCircle(segments(rad, num));
+  addRing(bt, vtx, rad, w, tbl, true);
+}
+
+void
+fillCircle(const Vertex& vtx, float rad, int num)
+{
+  auto& bt  = append();
+  auto& tbl = unitCircle(segments(rad, num));
+  addFan(bt, vtx, rad, tbl, true);
+}
+
+void
+drawArc(const Vertex& vtx, float rad, float start, float end, int num,
+        float w)
+{
+  auto& bt  = append();
+  auto& pts = unitArc(start, end, segments(rad, num));
+  addRing(bt, vtx, rad, w, pts, false);
+}
+
+void
+fillArc(const Vertex& vtx, float rad, float start, float end, int num)
+{
+  auto& bt  = append();
+  auto& pts = unitArc(start, end, segments(rad, num));
+  addFan(bt, vtx, rad, pts, false);
+}
+
+void
+drawCircles(const VertexList& vlist, float rad, int num, float w)
+{
+  auto& bt  = append();
+  auto& tbl = unitCircle(segments(rad, num));
+  bt.vertex.reserve(bt.vertex.size() + vlist.size() * tbl.size() * 2);
+  bt.index.reserve(bt.index.size() + vlist.size() * tbl.size() * 6);
+  for (auto& v : vlist)
+    addRing(bt, v, rad, w, tbl, true);
+}
+
+void
+fillCircles(const VertexList& vlist, float rad, int num)
+{
+  auto& bt  = append();
+  auto& tbl = unitCircle(segments(rad, num));
+  bt.vertex.reserve(bt.vertex.size() + vlist.size() * (tbl.size() + 1));
+  bt.index.reserve(bt.index.size() + vlist.size() * tbl.size() * 3);
+  for (auto& v : vlist)
+    addFan(bt, v, rad, tbl, true);
+}
+
+void
+drawBox(double lx, double ty, double rx, double by, const Color& col, bool fill)
+{
+  auto& bt = append(false, true);
+  auto  lt = boxVertex(lx, ty, col);
+  auto  rb = boxVertex(rx, by, col);
+  auto  rt = lt;
+  auto  lb = rb;
+  rt.x     = rb.x;
+  lb.x     = lt.x;
+  if (fill)
   {
-    auto& v = vlist[i];
-    v       = vtx;
-    auto r  = (ofs + i) / (float)num;
-    v.x += std::sinf(2.0f * M_PI * r) * rad;
-    v.y += std::cosf(2.0f * M_PI * r) * rad;
+    addQuad(bt, lt, rt, rb, lb);
+    return;
   }
-  glLineWidth(w);
-  draw(vlist, GL_LINE_LOOP);
+
+  // 辺を中心に幅1ピクセルの枠(角も埋まるように上下の辺を横に伸ばす)
+  float hw   = 0.5f * pixel_size;
+  float l    = std::min(lt.x, rb.x);
+  float r    = std::max(lt.x, rb.x);
+  float b    = std::min(lt.y, rb.y);
+  float t    = std::max(lt.y, rb.y);
+  auto  quad = [&](float l, float t, float r, float b) {
+    auto v0 = lt, v1 = lt, v2 = lt, v3 = lt;
+    v0.x = v3.x = l;
+    v1.x = v2.x = r;
+    v0.y = v1.y = t;
+    v2.y = v3.y = b;
+    addQuad(bt, v0, v1, v2, v3);
+  };
+  quad(l - hw, t + hw, r + hw, t - hw);
+  quad(l - hw, b + hw, r + hw, b - hw);
+  quad(l - hw, t - hw, l + hw, b + hw);
+  quad(r - hw, t - hw, r + hw, b + hw);
 }
 
 void
-drawBox(double lx, double ty, double rx, double by, const Color& col, bool fill)
+drawRect(double lx, double ty, double rx, double by, const Color& fill,
+         const Color& border, float w)
+{
+  if (border.a <= 0.0f)
+    w = 0.0f;
+  bool  inst = rect_array && !recording;
+  auto& bt   = append(inst, true);
+  auto  p0   = boxVertex(lx, ty, fill);
+  auto  p1   = boxVertex(rx, by, fill);
+  // 上下の向きは座標系で違うので小さい方から
+  float l = std::min(p0.x, p1.x);
+  float r = std::max(p0.x, p1.x);
+  float b = std::min(p0.y, p1.y);
+  float t = std::max(p0.y, p1.y);
+  if (inst)
+  {
+    bt.rect.push_back({l, b, r - l, t - b, fill, border, w, DrawDepth});
+    stats.rects++;
+    return;
+  }
+
+  // インスタンス描画が使えなければ塗りと枠の四角形に分ける
+  auto quad = [&bt](float l, float t, float r, float b, const Color& c) {
+    Vertex lt{l, t, c.r, c.g, c.b, c.a};
+    Vertex rt{r, t, c.r, c.g, c.b, c.a};
+    Vertex rb{r, b, c.r, c.g, c.b, c.a};
+    Vertex lb{l, b, c.r, c.g, c.b, c.a};
+    addQuad(bt, lt, rt, rb, lb);
+  };
+  float bw = std::min(w * pixel_size, std::min(r - l, t - b) * 0.5f);
+  if (fill.a > 0.0f)
+    quad(l + bw, t - bw, r - bw, b + bw, fill);
+  if (bw > 0.0f)
+  {
+    quad(l, t, r, t - bw, border);
+    quad(l, b + bw, r, b, border);
+    quad(l, t - bw, l + bw, b + bw, border);
+    quad(r - bw, t - bw, r, b + bw, border);
+  }
+  stats.rects++;
+}
+
+//
+// メッシュ
+//
+namespace
 {
-  auto loc = Graphics::calcLocate(lx, ty, true);
-  auto sz  = Graphics::calcLocate(rx, by, true);
+GLenum
+meshMode(MeshType type)
+{
+  switch (type)
+  {
+  case MeshType::TriangleStrip:
+    return GL_TRIANGLE_STRIP;
+  case MeshType::TriangleFan:
+    return GL_TRIANGLE_FAN;
+  case MeshType::Lines:
+    return GL_LINES;
+  case MeshType::LineStrip:
+    return GL_LINE_STRIP;
+  default:
+    return GL_TRIANGLES;
+  }
+}
 
-  auto& vl = box_vertex;
-  vl[0].x  = loc.x;
-  vl[0].y  = loc.y;
-  vl[1].x  = sz.x;
-  vl[1].y  = loc.y;
-  vl[2].x  = sz.x;
-  vl[2].y  = sz.y;
-  vl[3].x  = loc.x;
-  vl[3].y  = sz.y;
+//
+class MeshImpl : public Mesh
+{
+public:
+  GLuint  buffer[2] = {}; // 頂点, インデックス(無ければ0)
+  GLenum  mode      = GL_TRIANGLES;
+  GLsizei count     = 0; // 描く頂点(インデックス)の数
+  size_t  vertices  = 0;
+  bool    pixel     = false; // ピクセル座標か
+  // 作った時の頂点毎の深度(updateで座標を変えても残す)
+  std::vector<float> depth;
 
-  for (auto& v : vl)
+  MeshImpl(const std::vector<DrawVertex>& vl, const std::vector<GLuint>& il,
+           GLenum m, bool p)
+      : mode(m), vertices(vl.size()), pixel(p)
   {
-    v.r = col.r;
-    v.g = col.g;
-    v.b = col.b;
-    v.a = col.a;
+    depth.reserve(vl.size());
+    for (auto& v : vl)
+      depth.push_back(v.z);
+    count = il.empty() ? vl.size() : il.size();
+    glGenBuffers(il.empty() ? 1 : 2, buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer[0]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(DrawVertex) * vl.size(), vl.data(),
+                 GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (buffer[1])
+    {
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer[1]);
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * il.size(),
+                   il.data(), GL_STATIC_DRAW);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
   }
-  if (fill)
+  ~MeshImpl() override { glDeleteBuffers(2, buffer); }
+
+  void update(const VertexList& vl, size_t offset) override
   {
-    vl.resize(4);
-    drawQuads(vl);
+    if (offset >= vertices)
+      return;
+    auto n = std::min(vl.size(), vertices - offset);
+    std::vector<DrawVertex> dv(n);
+    for (size_t i = 0; i < n; i++)
+    {
+      auto& v = vl[i];
+      dv[i]   = {v.x, v.y, depth[offset + i], v.r, v.g, v.b, v.a};
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, buffer[0]);
+    glBufferSubData(GL_ARRAY_BUFFER, sizeof(DrawVertex) * offset,
+                    sizeof(DrawVertex) * n, dv.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
   }
-  else
+  size_t size() const override { return vertices; }
+};
+} // namespace
+
+//
+MeshPtr
+createMesh(const VertexList& vlist, MeshType type)
+{
+  std::vector<DrawVertex> vl;
+  std::vector<GLuint>     il;
+  vl.reserve(vlist.size());
+  for (auto& v : vlist)
+    vl.push_back({v.x, v.y, 0.0f, v.r, v.g, v.b, v.a});
+  if (type == MeshType::Quads)
   {
-    vl.resize(5);
-    vl[4] = vl[0];
-    drawLine(vl);
+    vl.resize(vl.size() & ~3);
+    for (GLuint i = 0; i < vl.size(); i += 4)
+      il.insert(il.end(), {i, i + 1, i + 2, i, i + 2, i + 3});
   }
+  return std::make_shared<MeshImpl>(vl, il, meshMode(type), use_pixel);
+}
+
+//
+MeshPtr
+createMesh(const std::function<void()>& build)
+{
+  // 描画中の物とは別に溜める(深度は0から, 座標系は今の物)
+  Batch saved;
+  std::swap(saved, batch);
+  float depth = DrawDepth;
+  auto  ds    = depth_stack;
+  DrawDepth   = 0.0f;
+  batch.space = Space{use_pixel};
+  recording   = true;
+  build();
+  recording   = false;
+  DrawDepth   = depth;
+  depth_stack = ds;
+
+  auto mesh = std::make_shared<MeshImpl>(batch.vertex, batch.index,
+                                         GL_TRIANGLES, batch.space.pixel);
+  std::swap(saved, batch);
+  return mesh;
+}
+
+//
+void
+drawMesh(const MeshPtr& mesh, const Transform& tr, const Color& col)
+{
+  auto m = dynamic_cast<MeshImpl*>(mesh.get());
+  if (!m || m->count == 0 || recording)
+    return;
+  if (!batch.index.empty() || !batch.rect.empty())
+  {
+    stats.by_mesh++;
+    draw();
+  }
+
+  // 拡大・回転してから置く(深度は現在の物)
+  mat4x4 model, mvp;
+  mat4x4_translate(model, tr.x, tr.y, DrawDepth);
+  mat4x4_rotate_Z(model, model, tr.rotate);
+  mat4x4_scale_aniso(model, model, tr.scale_x, tr.scale_y, 1.0f);
+  calcMVP(mvp, Space{m->pixel, Graphics::getView()});
+  mat4x4_mul(mvp, mvp, model);
+  glUniformMatrix4fv(MVP, 1, GL_FALSE, (const GLfloat*)mvp);
+  glUniform4fv(TINT, 1, (const GLfloat*)&col);
+
+  setAttributes({m->buffer[0], 0});
+  if (m->buffer[1])
+  {
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m->buffer[1]);
+    glDrawElements(m->mode, m->count, GL_UNSIGNED_INT, nullptr);
+  }
+  else
+    glDrawArrays(m->mode, 0, m->count);
+
+  glUniform4fv(TINT, 1, (const GLfloat*)&Graphics::White);
+  stats.vertices += m->vertices;
+  stats.meshes++;
+  stats.flushes++;
 }
 
 } // namespace Primitive2D
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "gl_def.h"
+#include <functional>
+#include <memory>
 #include <vector>
 
 struct GLFWwindow;
@@ -20,18 +22,130 @@ struct Vertex
 using VertexList = std::vector<Vertex>;
 using Color      = Graphics::Color;
 
+// 線の繋ぎ目
+enum class LineJoin : int
+{
+  Miter,
+  Round,
+  Bevel
+};
+// 線の端
+enum class LineCap : int
+{
+  Butt,
+  Square,
+  Round
+};
+// 線の描き方(長さはピクセル)
+struct LineStyle
+{
+  float              width       = 1.0f;
+  LineJoin           join        = LineJoin::Miter;
+  LineCap            cap         = LineCap::Butt;
+  float              miter_limit = 4.0f; // 先端が太さの半分の何倍までか
+  std::vector<float> dash;               // 描く・空けるを交互に(空なら実線)
+  float              dash_offset = 0.0f;
+};
+
+// 描画統計(setupからの1フレーム分)
+// 頂点はまとめて転送し、状態が変わった時だけ描画する
+struct Statistics
+{
+  size_t flushes;      // 描画呼び出し回数
+  size_t upload_bytes; // 頂点・インデックス・インスタンスの転送量
+  size_t vertices;     // 頂点数
+  size_t rects;        // drawRectの矩形数
+  // 描画した理由(線も三角形にするので種類や太さでは分かれない)
+  size_t by_kind;      // 三角形と矩形が切り替わった
+  size_t by_scissor;   // シザリングが変わった
+  size_t by_space;     // 座標系・ビュー変換が変わった
+  size_t by_mesh;      // drawMeshの前
+  size_t by_flush;     // flush()・cleanup()
+  size_t meshes;       // drawMeshの回数(転送は無い)
+};
+
+// メッシュの頂点の並べ方
+enum class MeshType : int
+{
+  Triangles,
+  TriangleStrip,
+  TriangleFan,
+  Quads, // 4頂点毎の四角形
+  Lines,
+  LineStrip,
+};
+// 転送済みの頂点(変わらない図形を毎フレーム転送しない)
+struct Mesh
+{
+  virtual ~Mesh() = default;
+  // 頂点の一部を書き換える(offsetは頂点の番号, 頂点数と深度は変わらない)
+  virtual void   update(const VertexList&, size_t offset = 0) = 0;
+  virtual size_t size() const                                 = 0;
+};
+using MeshPtr = std::shared_ptr<Mesh>;
+// メッシュの置き方(座標系の単位, 回転はラジアンで反時計回り)
+struct Transform
+{
+  float x       = 0.0f;
+  float y       = 0.0f;
+  float scale_x = 1.0f;
+  float scale_y = 1.0f;
+  float rotate  = 0.0f;
+};
+
 void initialize();
 void setup(GLFWwindow*);
 void cleanup();
 void terminate();
+// 溜まっている頂点を描画する(直接GLで描く前に呼ぶ)
+void flush();
 void drawLine(const VertexList&, float w = 1.0f);
-void drawCircle(const Vertex&, float rad, int num, float w = 1.0f);
+// 繋ぎ目・端・破線のある線(色は頂点間で補間する)
+// 1/4ピクセル未満の移動は間引くので、長い時系列もそのまま渡せる
+void drawPath(const Vertex* vtx, size_t num, const LineStyle& style,
+              bool closed = false);
+inline void
+drawPath(const VertexList& vlist, const LineStyle& style, bool closed = false)
+{
+  drawPath(vlist.data(), vlist.size(), style, closed);
+}
+// 円(numは分割数, 0なら画面上の大きさから決める)
+void drawCircle(const Vertex&, float rad, int num = 0, float w = 1.0f);
+void fillCircle(const Vertex&, float rad, int num = 0);
+// 円弧(角度はラジアンでx軸から反時計回り, numは1周分の分割数)
+void drawArc(const Vertex&, float rad, float start, float end, int num = 0,
+             float w = 1.0f);
+void fillArc(const Vertex&, float rad, float start, float end, int num = 0);
+// 同じ半径の円をまとめて描く(中心と色は頂点毎)
+void drawCircles(const VertexList&, float rad, int num = 0, float w = 1.0f);
+void fillCircles(const VertexList&, float rad, int num = 0);
 void drawQuads(const VertexList&);
 void drawTriangles(const VertexList&);
+// 矩形の座標はウィンドウのピクセル(左上原点)
 void drawBox(double lx, double ty, double rx, double by, const Color& col,
              bool fill);
+// 塗りと枠(内側にwピクセル)を1つの矩形として描く(深度は現在の物)
+// 3.3以降はインスタンス描画でまとめて描く
+void drawRect(double lx, double ty, double rx, double by, const Color& fill,
+              const Color& border, float w = 1.0f);
+// 深度は頂点毎に持つので変えても描画は分かれない
+// 頂点の座標をウィンドウのピクセル(左上原点)にする
+// falseなら縦-1〜1, 横は縦横比で伸ばしたグラフィック座標
+// どちらもGraphics::setViewのビュー変換が掛かる
+void setPixelSpace(bool pixel);
+// 頂点を転送してメッシュを作る(座標系は今の物)
+MeshPtr createMesh(const VertexList&, MeshType type);
+// 描画関数で溜めた三角形をメッシュにする(その場では描かない)
+// 深度はsetDepthからの相対になる
+MeshPtr createMesh(const std::function<void()>& build);
+// メッシュを描く(深度は現在の物, 色は頂点色に掛ける)
+void drawMesh(const MeshPtr&, const Transform& tr = Transform{},
+              const Color& col = Graphics::White);
 void setDepth(float d);
+// 現在の深度を退避して変える(入れ子にできる, popDepthと対にする)
 void pushDepth(float d);
 void popDepth();
+//
+Statistics getStatistics();
 
 } // namespace Primitive2D
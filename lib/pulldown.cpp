@@ -1,6 +1,5 @@
 #include "pulldown.h"
 #include "bb.h"
-#include "codeconv.h"
 #include "gl.h"
 #include "layer.h"
 #include "primitive2d.h"
@@ -92,8 +91,7 @@ on_click(ClickAct action, bool enter)
 void
 print(const std::string& msg, double x, double y)
 {
-  auto loc = Graphics::calcLocate(x, y);
-  font->print(msg.c_str(), (float)loc.x, (float)loc.y);
+  font->printPixel(msg.c_str(), x, y);
 }
 
 // 選択したアイテムを決定
@@ -374,7 +372,7 @@ create(List&& l, size_t nb_disp)
   int ml = 0;
   for (auto& s : l)
   {
-    auto len = CodeConv::U8Length2(s.c_str()) * 21.0;
+    auto len = font->measure(s.c_str()).width;
     if (len > ml)
       ml = len;
   }
@@ -0,0 +1,384 @@
+#include "rasterizer.h"
+#include "fontface.h"
+#include FT_MODULE_H
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// FreeType 2.11以降は距離場を直接作れる
+#if FREETYPE_MAJOR > 2 || (FREETYPE_MAJOR == 2 && FREETYPE_MINOR >= 11)
+#define USE_FT_SDF 1
+#else
+#define USE_FT_SDF 0
+#endif
+
+namespace Rasterizer
+{
+namespace
+{
+using Key   = GlyphCache::Key;
+using Glyph = GlyphCache::Glyph;
+
+// 完了した文字
+struct Result
+{
+  Key   key;
+  Glyph glyph;
+  bool  success;
+};
+
+// ワーカースレッド1つ分
+// FreeTypeはスレッドセーフではないので、ライブラリとフェイスを個別に持つ
+struct Worker
+{
+  FT_Library             library = nullptr;
+  std::map<int, FT_Face> faces;
+  std::thread            thread;
+  bool                   leave = false;
+
+  FT_Face getFace(int id);
+  void    run();
+};
+
+std::vector<std::unique_ptr<Worker>> workers;
+std::deque<Key>                      request_queue;
+std::vector<Result>                  result_list;
+std::vector<Result>                  collect_list;
+std::unordered_set<Key>              pending;
+std::mutex                           queue_mutex;
+std::mutex                           result_mutex;
+std::condition_variable              queue_cond;
+bool                                 quit   = false;
+size_t                               remain = 0;
+
+//
+FT_Face
+Worker::getFace(int id)
+{
+  auto it = faces.find(id);
+  if (it != faces.end())
+    return it->second;
+
+  // フォントファイルはマップ済みのものを共有する
+  auto face = FontFace::openFace(library, id);
+  faces[id] = face;
+  return face;
+}
+
+//
+void
+Worker::run()
+{
+  for (;;)
+  {
+    Key key;
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex);
+      queue_cond.wait(lock, [this] {
+        return quit || leave || !request_queue.empty();
+      });
+      // 抜けるワーカーは、残るワーカーがいなければ要求を片付けてから
+      if (quit || (leave && (remain > 0 || request_queue.empty())))
+        break;
+      key = request_queue.front();
+      request_queue.pop_front();
+    }
+
+    Result res;
+    res.key     = key;
+    auto face   = getFace(GlyphCache::keyFace(key));
+    res.success = face && rasterize(face, GlyphCache::keySize(key),
+                                    GlyphCache::keyCode(key), res.glyph);
+
+    std::lock_guard<std::mutex> lock(result_mutex);
+    result_list.emplace_back(std::move(res));
+  }
+
+  for (auto& f : faces)
+    if (f.second)
+      FT_Done_Face(f.second);
+  faces.clear();
+}
+
+#if !USE_FT_SDF
+// 通常のビットマップから距離場を作る(FreeType 2.11未満用)
+void
+makeSDF(Glyph& glyph)
+{
+  constexpr int sp = GlyphCache::SDFSpread;
+  int           sw = glyph.width;
+  int           sh = glyph.height;
+  int           dw = sw + sp * 2;
+  int           dh = sh + sp * 2;
+
+  auto inside = [&](int x, int y) {
+    x -= sp;
+    y -= sp;
+    if (x < 0 || y < 0 || x >= sw || y >= sh)
+      return false;
+    return glyph.buffer[y * sw + x] >= 128;
+  };
+
+  std::vector<uint8_t> dst(dw * dh);
+  for (int y = 0; y < dh; y++)
+  {
+    for (int x = 0; x < dw; x++)
+    {
+      // 広がりの範囲内で反対側の一番近い点を探す
+      bool in = inside(x, y);
+      int  md = sp * sp * 2;
+      for (int oy = -sp; oy <= sp; oy++)
+      {
+        for (int ox = -sp; ox <= sp; ox++)
+        {
+          int d = ox * ox + oy * oy;
+          if (d < md && inside(x + ox, y + oy) != in)
+            md = d;
+        }
+      }
+      float dist = std::sqrt((float)md) / sp;
+      float v    = 0.5f + (in ? dist : -dist) * 0.5f;
+      dst[y * dw + x] = (uint8_t)(std::min(std::max(v, 0.0f), 1.0f) * 255.0f);
+    }
+  }
+  glyph.buffer.swap(dst);
+  glyph.width  = dw;
+  glyph.height = dh;
+  glyph.left -= sp;
+  glyph.top += sp;
+}
+#endif
+
+// 負の指定はハードウェアに合わせる
+int
+threadCount(int threads)
+{
+  if (threads >= 0)
+    return threads;
+  int hc = std::thread::hardware_concurrency();
+  return std::min(std::max(hc - 1, 1), 4);
+}
+
+//
+void
+start(int threads)
+{
+  threads = threadCount(threads);
+  quit    = false;
+  for (int i = workers.size(); i < threads; i++)
+  {
+    auto w = std::make_unique<Worker>();
+    if (FT_Init_FreeType(&w->library))
+    {
+      std::cerr << "Could not init freetype library(worker)" << std::endl;
+      break;
+    }
+    setupLibrary(w->library);
+    auto wp   = w.get();
+    w->thread = std::thread([wp] { wp->run(); });
+    workers.emplace_back(std::move(w));
+  }
+}
+
+// 余ったワーカーだけを止める(要求や結果はそのまま)
+void
+shrink(size_t threads)
+{
+  if (workers.size() <= threads)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    remain = threads;
+    for (size_t i = threads; i < workers.size(); i++)
+      workers[i]->leave = true;
+  }
+  queue_cond.notify_all();
+  for (size_t i = threads; i < workers.size(); i++)
+  {
+    workers[i]->thread.join();
+    FT_Done_FreeType(workers[i]->library);
+  }
+  workers.resize(threads);
+}
+
+//
+void
+stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    quit = true;
+    request_queue.clear();
+  }
+  queue_cond.notify_all();
+  for (auto& w : workers)
+  {
+    w->thread.join();
+    FT_Done_FreeType(w->library);
+  }
+  workers.clear();
+
+  std::lock_guard<std::mutex> lock(result_mutex);
+  result_list.clear();
+  pending.clear();
+}
+
+} // namespace
+
+//
+void
+initialize(int threads)
+{
+  start(threads);
+}
+
+//
+void
+terminate()
+{
+  stop();
+}
+
+//
+void
+setThreads(int threads)
+{
+  // 実行中の要求や出来上がった結果を捨てないよう、増減分だけ入れ替える
+  threads = threadCount(threads);
+  shrink(threads);
+  start(threads);
+}
+
+//
+int
+getThreads()
+{
+  return workers.size();
+}
+
+//
+void
+setupLibrary(FT_Library library)
+{
+#if USE_FT_SDF
+  // 既定の広がりはFreeTypeの版で違うので、アトラスの余白やシェーダーに合わせる
+  FT_Int spread = GlyphCache::SDFSpread;
+  FT_Property_Set(library, "sdf", "spread", &spread);
+  FT_Property_Set(library, "bsdf", "spread", &spread);
+#else
+  (void)library;
+#endif
+}
+
+//
+bool
+rasterize(FT_Face face, int size, char32_t ch, Glyph& glyph)
+{
+  bool sdf = (size & GlyphCache::SDFFlag) != 0;
+  size &= ~GlyphCache::SDFFlag;
+  if (face->size->metrics.y_ppem != size)
+    FT_Set_Pixel_Sizes(face, 0, size);
+
+#if USE_FT_SDF
+  auto flags = sdf ? FT_LOAD_NO_BITMAP : FT_LOAD_RENDER;
+#else
+  auto flags = FT_LOAD_RENDER;
+#endif
+  FT_Error err;
+  if (ch & GlyphCache::GlyphIndexFlag)
+    err = FT_Load_Glyph(face, ch & ~GlyphCache::GlyphIndexFlag, flags);
+  else
+    err = FT_Load_Char(face, ch, flags);
+  if (err)
+    return false;
+
+  auto g     = face->glyph;
+  bool empty = false;
+#if USE_FT_SDF
+  // 空白などは描画するものが無いだけなので失敗にはしない
+  if (sdf && FT_Render_Glyph(g, FT_RENDER_MODE_SDF))
+    empty = true;
+#endif
+
+  unsigned int w  = empty ? 0 : g->bitmap.width;
+  unsigned int h  = empty ? 0 : g->bitmap.rows;
+  size_t       sz = w * h;
+  glyph.buffer.resize(sz);
+  if (sz > 0)
+  {
+    // pitchが幅と一致しない場合があるので1行ずつコピー
+    for (unsigned int i = 0; i < h; i++)
+      memcpy(&glyph.buffer[i * w], g->bitmap.buffer + i * g->bitmap.pitch, w);
+  }
+  glyph.width  = w;
+  glyph.height = h;
+  glyph.left   = g->bitmap_left;
+  glyph.top    = g->bitmap_top;
+  // 送り幅は計測(FT_Get_Advance)と揃えて、ヒンティング前の値を丸める
+  glyph.ad_x   = std::round(g->linearHoriAdvance / 65536.0f) * 64.0f;
+  glyph.ad_y   = g->advance.y;
+#if !USE_FT_SDF
+  if (sdf && sz > 0)
+    makeSDF(glyph);
+#endif
+  return true;
+}
+
+//
+bool
+request(Key key)
+{
+  if (workers.empty() || !pending.insert(key).second)
+    return false;
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    request_queue.push_back(key);
+  }
+  queue_cond.notify_one();
+  return true;
+}
+
+//
+size_t
+collect()
+{
+  {
+    std::lock_guard<std::mutex> lock(result_mutex);
+    collect_list.swap(result_list);
+  }
+  for (auto& res : collect_list)
+  {
+    pending.erase(res.key);
+    // 失敗した文字も空で登録して、要求し直さないようにする
+    if (!res.success)
+      res.glyph = Glyph{};
+    GlyphCache::insert(res.key, std::move(res.glyph));
+  }
+  auto n = collect_list.size();
+  collect_list.clear();
+  return n;
+}
+
+//
+size_t
+getPending()
+{
+  return pending.size();
+}
+
+//
+bool
+isPending(Key key)
+{
+  return pending.count(key) > 0;
+}
+
+} // namespace Rasterizer
@@ -0,0 +1,31 @@
+// glyph rasterize utility
+#pragma once
+
+#include "glyphcache.h"
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+namespace Rasterizer
+{
+// 初期化(threads: ワーカー数, 負の値で自動, 0で同期処理)
+void initialize(int threads = -1);
+//
+void terminate();
+// ワーカー数の変更(要求済みの文字はそのまま処理される)
+void setThreads(int threads);
+//
+int getThreads();
+// FT_Libraryの設定(距離場の広がりをGlyphCache::SDFSpreadに合わせる)
+void setupLibrary(FT_Library library);
+// 指定フェイスで同期ラスタライズ
+bool rasterize(FT_Face face, int size, char32_t ch, GlyphCache::Glyph& glyph);
+// ワーカーへ要求(既に要求済みならfalse)
+bool request(GlyphCache::Key key);
+// 完了した文字をキャッシュへ登録(描画スレッドから呼ぶ)
+size_t collect();
+// 処理待ちの数
+size_t getPending();
+// 要求済みで未完了か
+bool isPending(GlyphCache::Key key);
+
+} // namespace Rasterizer
@@ -175,16 +175,11 @@ Box::scroll_clip()
 void
 Box::draw(const Color& fcol)
 {
-  auto loc = bbox.getLocate();
-  auto btm = bbox.getBottom();
-  Primitive2D::pushDepth(depth);
-  if (draw_sheet)
-  {
-    Primitive2D::setDepth(depth + 0.1f);
-    Primitive2D::drawBox(loc.x, loc.y, btm.x, btm.y, sheet_color, true);
-  }
-  Primitive2D::setDepth(depth + 0.08f);
-  Primitive2D::drawBox(loc.x, loc.y, btm.x, btm.y, fcol, false);
+  auto loc  = bbox.getLocate();
+  auto btm  = bbox.getBottom();
+  auto scol = draw_sheet ? sheet_color : Graphics::ClearColor;
+  Primitive2D::pushDepth(depth + 0.1f);
+  Primitive2D::drawRect(loc.x, loc.y, btm.x, btm.y, scol, fcol);
   Primitive2D::popDepth();
 }
 
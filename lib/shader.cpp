@@ -0,0 +1,135 @@
+#include "shader.h"
+
+//
+// シェーダは2.xの書き方で書いておき、3.0以降のコンテキストでは
+// バージョン行と読み替えのdefineを前に付けてコンパイルする
+// (コアプロファイルでも文字・画像・図形を同じシェーダで描けるように)
+//
+namespace Shader
+{
+namespace
+{
+// 3.0以降(バージョン行はコンテキストに合わせて前に付ける)
+const char* core_vt_header = "#define attribute in\n"
+                             "#define varying out\n";
+const char* core_fg_header = "#define varying in\n"
+                             "#define texture2D texture\n"
+                             "out vec4 frag_color;\n"
+                             "#define gl_FragColor frag_color\n";
+
+// コンテキストで使えるGLSLのバージョン(3.0以降)
+const char*
+coreVersion(int version)
+{
+  if (version >= 33)
+    return "#version 330 core\n";
+  if (version >= 32)
+    return "#version 150\n";
+  if (version >= 31)
+    return "#version 140\n";
+  return "#version 130\n";
+}
+
+} // namespace
+
+// 3.0未満のヘッダ・コンテキストなら0で旧来の方法にする
+int
+getVersion()
+{
+#if defined(GL_VERSION_3_0)
+  GLint major = 0, minor = 0;
+  glGetIntegerv(GL_MAJOR_VERSION, &major);
+  glGetIntegerv(GL_MINOR_VERSION, &minor);
+  return major >= 3 ? major * 10 + minor : 0;
+#else
+  return 0;
+#endif
+}
+
+//
+GLuint
+compile(GLenum type, const char* body, const char* legacy)
+{
+  int         version = getVersion();
+  const char* header  = "";
+  if (version >= 30)
+  {
+    legacy = coreVersion(version);
+    header = type == GL_VERTEX_SHADER ? core_vt_header : core_fg_header;
+  }
+  const char* src[] = {legacy, header, body};
+  auto        sh    = glCreateShader(type);
+  glShaderSource(sh, 3, src, nullptr);
+  glCompileShader(sh);
+  return sh;
+}
+
+// 3.3未満は出力の位置を書けないので結び付けておく
+void
+bindOutput(GLuint program)
+{
+#if defined(GL_VERSION_3_0)
+  if (getVersion() >= 30)
+    glBindFragDataLocation(program, 0, "frag_color");
+#endif
+}
+
+//
+GLuint
+createVertexArray(std::initializer_list<GLuint> attrs)
+{
+  GLuint vao = 0;
+#if defined(GL_VERSION_3_0)
+  if (getVersion() < 30)
+    return 0;
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+  for (auto idx : attrs)
+    glEnableVertexAttribArray(idx);
+  glBindVertexArray(0);
+#endif
+  return vao;
+}
+
+//
+void
+deleteVertexArray(GLuint& vao)
+{
+#if defined(GL_VERSION_3_0)
+  if (vao)
+    glDeleteVertexArrays(1, &vao);
+#endif
+  vao = 0;
+}
+
+//
+void
+bindAttributes(GLuint vao, std::initializer_list<GLuint> attrs)
+{
+#if defined(GL_VERSION_3_0)
+  if (vao)
+  {
+    glBindVertexArray(vao);
+    return;
+  }
+#endif
+  for (auto idx : attrs)
+    glEnableVertexAttribArray(idx);
+}
+
+//
+void
+unbindAttributes(GLuint vao, std::initializer_list<GLuint> attrs)
+{
+#if defined(GL_VERSION_3_0)
+  if (vao)
+  {
+    glBindVertexArray(0);
+    return;
+  }
+#endif
+  for (auto idx : attrs)
+    glDisableVertexAttribArray(idx);
+}
+
+} // namespace Shader
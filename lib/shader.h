@@ -0,0 +1,27 @@
+// shader utility
+#pragma once
+
+#include "gl.h"
+#include <initializer_list>
+
+namespace Shader
+{
+// 2.x向けのバージョン行(3.0未満のコンテキストで使う)
+constexpr const char* Legacy = "#version 120\n";
+
+// コンテキストのバージョン(3.3なら33, 3.0未満は0)
+int getVersion();
+// 2.xの書き方(attribute, varying, gl_FragColor, texture2D)のシェーダを
+// コンテキストに合わせたバージョンで作る
+GLuint compile(GLenum type, const char* body, const char* legacy = Legacy);
+// プログラムのリンク前に呼ぶ(3.0以降は出力の位置を結び付ける)
+void bindOutput(GLuint program);
+// 属性を有効にした頂点配列を作る(3.0未満なら0)
+GLuint createVertexArray(std::initializer_list<GLuint> attrs);
+//
+void deleteVertexArray(GLuint& vao);
+// 描画の前後に呼ぶ(頂点配列が無ければ属性を直接切り替える)
+void bindAttributes(GLuint vao, std::initializer_list<GLuint> attrs);
+void unbindAttributes(GLuint vao, std::initializer_list<GLuint> attrs);
+
+} // namespace Shader
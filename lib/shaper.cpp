@@ -0,0 +1,176 @@
+#include "shaper.h"
+#include "codeconv.h"
+#include "glyphcache.h"
+#include <string>
+#include <unordered_map>
+#if defined(USE_HARFBUZZ)
+#include <hb-ft.h>
+#include <hb.h>
+#include <map>
+#endif
+
+//
+// USE_HARFBUZZが定義されていればHarfBuzzで整形する(カーニング・合字・結合文字)
+// 無ければFreeTypeのカーニングだけ適用する
+//
+namespace Shaper
+{
+namespace
+{
+// キャッシュの上限(超えたら捨てる)
+constexpr size_t CacheMax = 4096;
+
+std::unordered_map<std::string, Run> cache;
+std::string                          cache_key;
+
+// 主フォントに無い文字を代替フォントで置く
+void
+placeFallback(Run& run, int fid, char32_t ch, int size,
+              const FaceFunc& get_face)
+{
+  auto  face = get_face(fid);
+  float ad   = 0.0f;
+  if (face)
+  {
+    if (face->size->metrics.y_ppem != size)
+      FT_Set_Pixel_Sizes(face, 0, size);
+    if (FT_Load_Char(face, ch, FT_LOAD_DEFAULT) == 0)
+      ad = face->glyph->advance.x / 64.0f;
+  }
+  run.glyphs.push_back({fid, ch, run.width, 0.0f});
+  run.width += ad;
+}
+
+#if defined(USE_HARFBUZZ)
+std::map<int, hb_font_t*> fonts;
+hb_buffer_t*              buffer = nullptr;
+
+//
+void
+shapeRun(Run& run, FT_Face face, int face_id, int size, const char* msg,
+         const ResolveFunc& resolve, const FaceFunc& get_face)
+{
+  auto& font = fonts[face_id];
+  if (!font)
+    font = hb_ft_font_create_referenced(face);
+  else
+    hb_ft_font_changed(font); // サイズはウィジェット毎に違う
+  if (!buffer)
+    buffer = hb_buffer_create();
+
+  hb_buffer_reset(buffer);
+  hb_buffer_add_utf8(buffer, msg, -1, 0, -1);
+  hb_buffer_guess_segment_properties(buffer);
+  hb_shape(font, buffer, nullptr, 0);
+
+  unsigned int n;
+  auto         info = hb_buffer_get_glyph_infos(buffer, &n);
+  auto         pos  = hb_buffer_get_glyph_positions(buffer, &n);
+  float        y    = 0.0f;
+  for (unsigned int i = 0; i < n; i++)
+  {
+    if (info[i].codepoint == 0)
+    {
+      char32_t ch;
+      CodeConv::U8ToU32(msg + info[i].cluster, ch);
+      int fid = resolve(ch);
+      if (fid != face_id)
+      {
+        placeFallback(run, fid, ch, size, get_face);
+        continue;
+      }
+    }
+    float x  = run.width + pos[i].x_offset / 64.0f;
+    float oy = y + pos[i].y_offset / 64.0f;
+    run.glyphs.push_back(
+        {face_id, info[i].codepoint | GlyphCache::GlyphIndexFlag, x, oy});
+    run.width += pos[i].x_advance / 64.0f;
+    y += pos[i].y_advance / 64.0f;
+  }
+}
+#else
+// カーニングのみ
+void
+shapeRun(Run& run, FT_Face face, int face_id, int size, const char* msg,
+         const ResolveFunc& resolve, const FaceFunc& get_face)
+{
+  bool     kern = FT_HAS_KERNING(face);
+  FT_UInt  prev = 0;
+  auto     p    = msg;
+  char32_t ch;
+  while (int r = CodeConv::U8ToU32(p, ch))
+  {
+    if (ch == '\0')
+      break;
+
+    p += r;
+    int fid = resolve(ch);
+    if (fid != face_id)
+    {
+      placeFallback(run, fid, ch, size, get_face);
+      prev = 0;
+      continue;
+    }
+    auto gidx = FT_Get_Char_Index(face, ch);
+    if (kern && prev && gidx)
+    {
+      FT_Vector delta;
+      if (FT_Get_Kerning(face, prev, gidx, FT_KERNING_DEFAULT, &delta) == 0)
+        run.width += delta.x / 64.0f;
+    }
+    float ad = 0.0f;
+    if (FT_Load_Glyph(face, gidx, FT_LOAD_DEFAULT) == 0)
+      ad = face->glyph->advance.x / 64.0f;
+    run.glyphs.push_back(
+        {face_id, gidx | GlyphCache::GlyphIndexFlag, run.width, 0.0f});
+    run.width += ad;
+    prev = gidx;
+  }
+}
+#endif
+
+} // namespace
+
+//
+const Run&
+shape(FT_Face face, int face_id, int size, const char* msg,
+      const ResolveFunc& resolve, const FaceFunc& get_face)
+{
+  cache_key.assign(msg);
+  cache_key.push_back('\0');
+  cache_key.append((const char*)&face_id, sizeof(face_id));
+  cache_key.append((const char*)&size, sizeof(size));
+  auto it = cache.find(cache_key);
+  if (it != cache.end())
+    return it->second;
+
+  if (cache.size() >= CacheMax)
+    cache.clear();
+  auto& run = cache[cache_key];
+  shapeRun(run, face, face_id, size, msg, resolve, get_face);
+  return run;
+}
+
+//
+void
+clear()
+{
+  cache.clear();
+}
+
+//
+void
+terminate()
+{
+  cache.clear();
+#if defined(USE_HARFBUZZ)
+  for (auto& f : fonts)
+    hb_font_destroy(f.second);
+  fonts.clear();
+  if (buffer)
+    hb_buffer_destroy(buffer);
+  buffer = nullptr;
+#endif
+}
+
+} // namespace Shaper
@@ -0,0 +1,40 @@
+// text shaping utility
+#pragma once
+
+#include <functional>
+#include <ft2build.h>
+#include <vector>
+#include FT_FREETYPE_H
+
+namespace Shaper
+{
+// 整形済みの文字1つ分
+// codeはGlyphCache::GlyphIndexFlag付きならグリフ番号, 無ければ文字コード
+struct Glyph
+{
+  int      face;
+  char32_t code;
+  float    x; // 原点からの位置(ピクセル, 上が正)
+  float    y;
+};
+// 整形済みの文字列
+struct Run
+{
+  std::vector<Glyph> glyphs;
+  float              width = 0.0f; // 送り幅の合計
+};
+// 主フォントに無い文字を描くフェイスIDを返す
+using ResolveFunc = std::function<int(char32_t)>;
+// フェイスIDからフェイスを返す
+using FaceFunc = std::function<FT_Face(int)>;
+
+// 文字列を整形する(face_id, size, 文字列で結果をキャッシュする)
+// faceは呼び出し側でsizeに合わせておくこと
+const Run& shape(FT_Face face, int face_id, int size, const char* msg,
+                 const ResolveFunc& resolve, const FaceFunc& get_face);
+// キャッシュ破棄(代替フォントが変わった時など)
+void clear();
+//
+void terminate();
+
+} // namespace Shaper
@@ -42,10 +42,8 @@ struct SheetImpl : public Base
     auto loc = bbox.getLocate();
     auto btm = bbox.getBottom();
     Primitive2D::setDepth(d);
-    if (border.a > 0.0f)
-      Primitive2D::drawBox(loc.x, loc.y, btm.x, btm.y, border, false);
-    if (fill.a > 0.0f)
-      Primitive2D::drawBox(loc.x, loc.y, btm.x, btm.y, fill, true);
+    if (border.a > 0.0f || fill.a > 0.0f)
+      Primitive2D::drawRect(loc.x, loc.y, btm.x, btm.y, fill, border);
 
     Graphics::disableScissor();
   }
@@ -0,0 +1,241 @@
+#include "streambuffer.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+//
+// 頂点転送用のリングバッファ
+// GL_ARB_buffer_storageがあれば永続マップして3フレーム分の区画に分け、
+// 3フレーム前の描画完了をフェンスで待ってから同じ区画に書き込む
+// 無ければフレーム毎に1度だけ捨てて(orphaning)glBufferSubDataで書き込む
+//
+#if defined(GL_MAP_PERSISTENT_BIT) && defined(GL_SYNC_GPU_COMMANDS_COMPLETE)
+#define HAS_BUFFER_STORAGE
+#endif
+
+namespace StreamBuffer
+{
+namespace
+{
+constexpr int FrameCount = 3;
+
+GLuint     buffer     = 0;
+uint8_t*   mapped     = nullptr; // 永続マップ(使えなければnullptr)
+size_t     frame_size = 0;       // 1フレーム分の容量
+size_t     head       = 0;       // 次に書き込む位置
+size_t     limit      = 0;       // このフレームで書き込める終わり
+int        frame      = 0;       // 使用中の区画
+Statistics stats{};
+
+// 作り直した古いバッファ(このフレームの描画で使うので次のフレームで消す)
+std::vector<GLuint> retired;
+
+#if defined(HAS_BUFFER_STORAGE)
+constexpr GLbitfield MapFlags =
+    GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+GLsync fences[FrameCount] = {};
+
+// 区画を使った描画が終わるのを待つ
+void
+wait(GLsync& fence)
+{
+  if (!fence)
+    return;
+  auto ret = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+  if (ret == GL_TIMEOUT_EXPIRED)
+  {
+    stats.waits++;
+    do
+      ret = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    while (ret == GL_TIMEOUT_EXPIRED);
+  }
+  glDeleteSync(fence);
+  fence = nullptr;
+}
+#endif
+
+// 永続マップできるか(4.4以降か拡張があれば)
+bool
+supportStorage()
+{
+#if defined(HAS_BUFFER_STORAGE)
+  GLint major = 0, minor = 0;
+  glGetIntegerv(GL_MAJOR_VERSION, &major);
+  glGetIntegerv(GL_MINOR_VERSION, &minor);
+  if (major * 10 + minor >= 44)
+    return true;
+  if (major < 3)
+    return false;
+  GLint n = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+  for (GLint i = 0; i < n; i++)
+  {
+    auto ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+    if (ext && std::strcmp(ext, "GL_ARB_buffer_storage") == 0)
+      return true;
+  }
+#endif
+  return false;
+}
+
+// 現在の区画の書き込み範囲
+void
+resetRange()
+{
+  head  = mapped ? frame * frame_size : 0;
+  limit = head + frame_size;
+}
+
+//
+void
+create(size_t size)
+{
+  frame_size     = size;
+  stats.capacity = size;
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+#if defined(HAS_BUFFER_STORAGE)
+  if (stats.persistent)
+  {
+    auto total = size * FrameCount;
+    glBufferStorage(GL_ARRAY_BUFFER, total, nullptr, MapFlags);
+    mapped = (uint8_t*)glMapBufferRange(GL_ARRAY_BUFFER, 0, total, MapFlags);
+    if (mapped)
+      return;
+    // マップできなければ以後は転送で済ませる
+    stats.persistent = false;
+    glDeleteBuffers(1, &buffer);
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  }
+#endif
+  glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+}
+
+// 古いバッファを手放す(描画中のバッファを消してもGLは描画が終わるまで保持する)
+void
+destroy()
+{
+#if defined(HAS_BUFFER_STORAGE)
+  for (auto& f : fences)
+  {
+    if (f)
+      glDeleteSync(f);
+    f = nullptr;
+  }
+#endif
+  mapped = nullptr;
+  if (buffer)
+    retired.push_back(buffer);
+  buffer = 0;
+}
+
+//
+void
+deleteRetired()
+{
+  if (!retired.empty())
+    glDeleteBuffers(retired.size(), retired.data());
+  retired.resize(0);
+}
+
+} // namespace
+
+//
+void
+initialize(size_t size)
+{
+  if (buffer)
+    return;
+  stats            = Statistics{};
+  stats.persistent = supportStorage();
+  create(size);
+  resetRange();
+}
+
+//
+void
+terminate()
+{
+  destroy();
+  deleteRetired();
+  frame_size = 0;
+  head       = 0;
+  limit      = 0;
+}
+
+//
+void
+beginFrame()
+{
+  if (!buffer)
+    initialize();
+  stats.uploads      = 0;
+  stats.upload_bytes = 0;
+  stats.waits        = 0;
+  frame              = (frame + 1) % FrameCount;
+  deleteRetired();
+#if defined(HAS_BUFFER_STORAGE)
+  if (mapped)
+    wait(fences[frame]);
+#endif
+  if (!mapped)
+  {
+    // 前のフレームの領域は捨てて新しく貰う
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, frame_size, nullptr, GL_STREAM_DRAW);
+  }
+  resetRange();
+}
+
+//
+void
+endFrame()
+{
+#if defined(HAS_BUFFER_STORAGE)
+  if (mapped)
+    fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+}
+
+//
+Range
+upload(const void* data, size_t size, size_t align)
+{
+  if (!buffer)
+    initialize();
+  head = (head + align - 1) / align * align;
+  if (head + size > limit)
+  {
+    // 足りなければ大きくして作り直す
+    // 既に返した範囲は古いバッファのまま次のフレームまで使える
+    auto nsize = std::max(frame_size * 2, size * 2);
+    destroy();
+    create(nsize);
+    resetRange();
+    stats.grows++;
+  }
+
+  if (mapped)
+    std::memcpy(mapped + head, data, size);
+  else
+  {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferSubData(GL_ARRAY_BUFFER, head, size, data);
+  }
+  Range ret{buffer, head};
+  head += size;
+  stats.uploads++;
+  stats.upload_bytes += size;
+  return ret;
+}
+
+//
+Statistics
+getStatistics()
+{
+  return stats;
+}
+
+} // namespace StreamBuffer
@@ -0,0 +1,43 @@
+// streaming vertex buffer
+#pragma once
+
+#include "gl.h"
+#include <cstddef>
+
+namespace StreamBuffer
+{
+// 1フレーム分の初期容量(足りなければ倍にして作り直す)
+constexpr size_t DefaultSize = 4 * 1024 * 1024;
+
+// 書き込んだ場所
+struct Range
+{
+  GLuint buffer; // バインドするバッファ
+  size_t offset; // バッファ先頭からのバイト数
+};
+
+// 統計(beginFrameからの1フレーム分)
+struct Statistics
+{
+  size_t uploads;      // upload呼び出し回数
+  size_t upload_bytes; // 書き込んだバイト数
+  size_t capacity;     // 1フレーム分の容量
+  size_t grows;        // 容量が足りずにバッファを作り直した回数(累計)
+  size_t waits;        // GPUの完了を待った回数
+  bool   persistent;   // 永続マップで動いているか
+};
+
+//
+void initialize(size_t frame_size = DefaultSize);
+//
+void terminate();
+// フレーム開始(3フレーム前の描画が終わるのを待つ)
+void beginFrame();
+// フレーム終了(このフレームの描画完了をフェンスで記録する)
+void endFrame();
+// 頂点・インデックスを書き込む(GL_ARRAY_BUFFERのバインドは変わる)
+Range upload(const void* data, size_t size, size_t align = 16);
+//
+Statistics getStatistics();
+
+} // namespace StreamBuffer
@@ -10,6 +10,21 @@ namespace TextInput
 {
 namespace
 {
+// UTF-32の範囲をUTF-8に変換
+std::string
+toU8(Buffer::const_iterator b, Buffer::const_iterator e)
+{
+  std::string r;
+  r.reserve(std::distance(b, e));
+  for (auto it = b; it != e; ++it)
+  {
+    char buff[4];
+    int  cnt = CodeConv::U32ToU8(*it, buff);
+    r.append(buff, cnt);
+  }
+  return r;
+}
+
 struct Manage
 {
   Buffer&          buffer;
@@ -24,20 +39,7 @@ struct Manage
   }
 
   // 文字列取得
-  std::string getString() const
-  {
-    std::string r;
-    r.reserve(buffer.size());
-    r.resize(0);
-    for (auto& c : buffer)
-    {
-      char b[4];
-      int  cnt = CodeConv::U32ToU8(c, b);
-      for (int i = 0; i < cnt; i++)
-        r.push_back(b[i]);
-    }
-    return r;
-  }
+  std::string getString() const { return toU8(buffer.begin(), buffer.end()); }
 
   // 入力候補更新
   void updatePulldown()
@@ -292,15 +294,43 @@ setIndex(size_t p)
 
 //
 CursorOffset
-getIndexPos()
+getIndexPos(FontDraw::WidgetPtr font)
 {
   CursorOffset ofs;
-  auto         c = getIndex();
-  ofs.left       = 21.0 * c;
-  ofs.right      = ofs.left + 21.0;
+  auto&        buffer = manage->buffer;
+  auto         c      = getIndex();
+  auto         s      = toU8(buffer.begin(), manage->index);
+  ofs.left            = font->measure(s.c_str()).width;
+  if (c < buffer.size())
+  {
+    // カーソル下の文字の幅
+    auto n    = toU8(manage->index, std::next(manage->index));
+    ofs.right = ofs.left + font->measure(n.c_str()).width;
+  }
+  else
+    ofs.right = ofs.left + font->getSizeX();
   return ofs;
 }
 
+//
+size_t
+getIndexFromPos(FontDraw::WidgetPtr font, double x)
+{
+  auto&  buffer = manage->buffer;
+  double l      = 0.0;
+  size_t idx    = 0;
+  for (auto it = buffer.begin(); it != buffer.end(); ++it, ++idx)
+  {
+    auto   s = toU8(it, std::next(it));
+    double w = font->measure(s.c_str()).width;
+    // 文字の半分より左ならその文字の前
+    if (x < l + w * 0.5)
+      break;
+    l += w;
+  }
+  return idx;
+}
+
 //
 std::string
 get()
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "font.h"
 #include "parts.h"
 #include "text_def.h"
 #include <string>
@@ -26,7 +27,9 @@ size_t getIndex();
 // カーソルの位置を指定
 void setIndex(size_t);
 // カーソルを表示するべきX座標を取得
-CursorOffset getIndexPos();
+CursorOffset getIndexPos(FontDraw::WidgetPtr font);
+// X座標(文字列の先頭から)に一番近いカーソルの位置を取得
+size_t getIndexFromPos(FontDraw::WidgetPtr font, double x);
 // 入力された文字列を取得(UTF-8)
 std::string get();
 // バッファーに指定文字列を設定する
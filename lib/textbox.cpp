@@ -123,9 +123,9 @@ on_click(ClickAct action, bool enter)
       }
       // クリックした位置にカーソルを設定する
       auto mpos = Graphics::getMousePosition();
-      auto xp   = (mpos.x - focus_input->getX() - 10.0) / 21.0;
+      auto xp   = mpos.x - focus_input->getX() - 10.0;
       if (xp >= 0)
-        TextInput::setIndex(xp);
+        TextInput::setIndex(TextInput::getIndexFromPos(font, xp));
     }
   }
 }
@@ -180,7 +180,7 @@ ItemImpl::drawCursor()
   auto loc = bbox.getLocate();
   loc.x += BaseX;
   loc.y += ofs_y;
-  auto ofs = TextInput::getIndexPos();
+  auto ofs = TextInput::getIndexPos(font);
   auto l1  = Graphics::calcLocate(loc.x + ofs.left, loc.y, true);
   auto l2  = Graphics::calcLocate(loc.x + ofs.right, loc.y, true);
   static Primitive2D::VertexList ul = {
@@ -218,16 +218,17 @@ ItemImpl::draw()
       text = TextInput::get();
   }
 
-  auto pos = Graphics::calcLocate(loc.x + BaseX, loc.y + ofs_y);
+  auto px = loc.x + BaseX;
+  auto py = loc.y + ofs_y;
   if (text.empty())
   {
     font->setColor(ph_color);
-    font->print(place_holder.c_str(), pos.x, pos.y);
+    font->printPixel(place_holder.c_str(), px, py);
   }
   else
   {
     font->setColor(font_color);
-    font->print(text.c_str(), pos.x, pos.y);
+    font->printPixel(text.c_str(), px, py);
   }
 
   Graphics::disableScissor();
@@ -269,9 +270,9 @@ create(std::string t, double x, double y, double w, double h)
 {
   if (w == 0.0)
   {
-    w = t.length() * 21;
+    w = font->measure(t.c_str()).width;
     if (w == 0.0)
-      w = 16 * 21;
+      w = 16 * font->getSizeX();
     w += 40;
     x -= 20.0;
   }
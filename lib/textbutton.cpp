@@ -1,6 +1,5 @@
 #include "textbutton.h"
 #include "bb.h"
-#include "codeconv.h"
 #include "font.h"
 #include "gl.h"
 #include "layer.h"
@@ -34,21 +33,21 @@ std::map<ColorType, Color> color_map = {
 struct Button : public Base
 {
   ~Button() = default;
-  std::string   caption;
-  double        length;
-  PressCallback cb;
-  bool          catch_enter;
-  bool          press;
-  Color         c_ufbg;
-  Color         c_fbg;
-  Color         c_pbg;
-  Color         c_uff;
-  Color         c_ff;
-  Color         c_pf;
-  Color         c_bd;
-  Pulldown::ID  pulldown;
+  FontDraw::TextRunPtr caption = FontDraw::createTextRun();
+  double               length;
+  PressCallback        cb;
+  bool                 catch_enter;
+  bool                 press;
+  Color                c_ufbg;
+  Color                c_fbg;
+  Color                c_pbg;
+  Color                c_uff;
+  Color                c_ff;
+  Color                c_pf;
+  Color                c_bd;
+  Pulldown::ID         pulldown;
 
-  void setCaption(std::string c) override { caption = c; }
+  void setCaption(std::string c) override { caption->set(c); }
   bool getFocus() const override;
   void setColor(ColorType ct, Graphics::Color col) override
   {
@@ -170,10 +169,9 @@ text_button(ClickAct action, bool enter)
 
 //
 void
-print(const std::string& msg, double x, double y)
+print(const FontDraw::TextRunPtr& msg, double x, double y)
 {
-  auto loc = Graphics::calcLocate(x, y);
-  font->print(msg.c_str(), (float)loc.x, (float)loc.y);
+  font->printPixel(msg, x, y);
 }
 
 //
@@ -203,15 +201,10 @@ Button::draw(ColorType fg, ColorType bg)
   auto bcol = getColor(bg);
   auto loc  = bbox.getLocate();
   auto btm  = bbox.getBottom();
-  if (bcol.a > 0.0f)
+  if (bcol.a > 0.0f || c_bd.a > 0.0f)
   {
     Primitive2D::setDepth(depth);
-    Primitive2D::drawBox(loc.x, loc.y, btm.x, btm.y, bcol, true);
-  }
-  if (c_bd.a > 0.0f)
-  {
-    Primitive2D::setDepth(depth - 0.02f);
-    Primitive2D::drawBox(loc.x, loc.y, btm.x, btm.y, c_bd, false);
+    Primitive2D::drawRect(loc.x, loc.y, btm.x, btm.y, bcol, c_bd);
   }
 
   // キャプション
@@ -239,12 +232,11 @@ ID
 setButton(std::string caption, double x, double y, PressCallback cb,
           bool catch_enter)
 {
-  double l  = CodeConv::U8Length2(caption.c_str()) * 21.0;
+  double l  = font->measure(caption.c_str()).width;
   auto   rx = x + l + 20 + 20;
   auto   by = y + 20 + 32 + 10;
 
   auto btn         = std::make_shared<Button>();
-  btn->caption     = caption;
   btn->length      = l;
   btn->cb          = cb;
   btn->press       = false;
@@ -256,6 +248,7 @@ setButton(std::string caption, double x, double y, PressCallback cb,
   btn->c_ff        = color_map[ColorType::FocusFont];
   btn->c_pf        = color_map[ColorType::PressFont];
   btn->c_bd        = color_map[ColorType::Border];
+  btn->caption->set(caption);
   btn->initGeometry(x, y, rx - x, by - y);
 
   auto& button_list = layer.getCurrent();
@@ -1,9 +1,22 @@
 #include "texture2d.h"
 #include "gl.h"
+#include "mapfile.h"
+#include "shader.h"
+#include "streambuffer.h"
+#include <algorithm>
 #include <cmath>
+#include <condition_variable>
+#include <csetjmp>
+#include <cstring>
+#include <deque>
 #include <exception>
+#include <filesystem>
 #include <iostream>
+#include <mutex>
 #include <png.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace Texture2D
@@ -13,40 +26,100 @@ namespace
 {
 using Color    = Graphics::Color;
 using DrawArea = Graphics::DrawArea;
+using View     = Graphics::View;
 
-// shader
-const char* vtx_sh_s = "#version 120\n"
-                       "attribute vec4 coord;\n"
+// shader(2.xの書き方で、バージョン行はShader::compileで付ける)
+const char* vtx_sh_s = "attribute vec4 coord;\n"
                        "varying vec2 texcoord;\n"
                        "uniform float Depth;\n"
+                       "uniform mat4 MVP;\n"
                        "void main(void) {\n"
-                       "  gl_Position = vec4(coord.xy, Depth, 1);\n"
+                       "  vec4 p      = MVP * vec4(coord.xy, 0, 1);\n"
+                       "  gl_Position = vec4(p.xy, Depth, 1);\n"
                        "  texcoord    = coord.zw;\n"
                        "}";
-const char* frag_sh_s = "#version 120\n"
-                        "varying vec2 texcoord;\n"
+const char* frag_sh_s = "varying vec2 texcoord;\n"
                         "uniform sampler2D tex;\n"
                         "uniform vec4 color;\n"
                         "void main(void) {\n"
-                        "  gl_FragColor = texture2D(tex, texcoord) * color;\n"
+                        "  vec4 c     = vec4(color.rgb * color.a, color.a);\n"
+                        "  gl_FragColor = texture2D(tex, texcoord) * c;\n"
                         "}";
 
-GLuint   vb_obj;
 GLuint   vtx_sh, frg_sh, sh_prog;
-GLint    attr_coord, uni_col, uni_tex, uni_depth;
+GLuint   vertex_array = 0; // コアプロファイル用(使えなければ0)
+GLint    attr_coord, uni_col, uni_tex, uni_depth, uni_mvp;
 DrawArea draw_area{};
 
 //
-struct ImageImpl : public Image
+// 読み込んだ画像はパス(正規化したもの)と内容のハッシュで覚えておき
+// 同じ画像なら展開せずに同じImagePtrを返す
+// 誰も参照しなくなった画像は消えて登録も外れる
+//
+struct ImageImpl;
+std::unordered_map<std::string, std::weak_ptr<ImageImpl>> path_cache;
+std::unordered_map<uint64_t, std::weak_ptr<ImageImpl>>    hash_cache;
+Statistics                                                stats{};
+
+// 展開した画像(RGBかRGBA, アルファは乗算済み)
+struct Pixels
+{
+  std::vector<png_byte> buffer;
+  int                   width    = 0;
+  int                   height   = 0;
+  int                   channels = 0;
+};
+
+// 登録から外す(消える画像のものだけ)
+template <class Map, class Key>
+void
+unregist(Map& map, const Key& key)
 {
-  int    width  = 0;
-  int    height = 0;
-  GLuint tex_id = 0;
+  auto it = map.find(key);
+  if (it != map.end() && it->second.expired())
+    map.erase(it);
+}
 
-  ~ImageImpl() { clear(); };
+//
+struct ImageImpl : public Image
+{
+  int                      width  = 0;
+  int                      height = 0;
+  GLuint                   tex_id = 0;
+  size_t                   bytes  = 0;
+  uint64_t                 hash   = 0;
+  bool                     ready  = false;
+  bool                     failed = false;
+  std::vector<std::string> paths; // このイメージを指すパス
+
+  ~ImageImpl()
+  {
+    clear();
+    for (auto& p : paths)
+      unregist(path_cache, p);
+    unregist(hash_cache, hash);
+    if (bytes)
+    {
+      stats.images--;
+      stats.resident_bytes -= bytes;
+    }
+  };
   //
-  int getWidth() const override { return width; }
-  int getHeight() const override { return height; }
+  int  getWidth() const override { return width; }
+  int  getHeight() const override { return height; }
+  bool isReady() const override { return ready; }
+  bool isFailed() const override { return failed; }
+
+  // 展開した画像をテクスチャにする
+  void upload(const Pixels& pix)
+  {
+    width  = pix.width;
+    height = pix.height;
+    createRGB((void*)pix.buffer.data(), pix.channels);
+    bytes = pix.buffer.size();
+    stats.images++;
+    stats.resident_bytes += bytes;
+  }
 
   void createRGB(void* buffer, int ch)
   {
@@ -57,9 +130,10 @@ struct ImageImpl : public Image
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    auto t = (ch == 4) ? GL_RGBA : (ch == 3) ? GL_RGB : GL_LUMINANCE_ALPHA;
+    auto t = (ch == 4) ? GL_RGBA : GL_RGB;
     glTexImage2D(GL_TEXTURE_2D, 0, t, width, height, 0, t, GL_UNSIGNED_BYTE,
                  buffer);
+    ready = true;
   }
   void bind() { glBindTexture(GL_TEXTURE_2D, tex_id); }
   void clear() { glDeleteTextures(1, &tex_id); }
@@ -68,40 +142,377 @@ struct ImageImpl : public Image
 struct DrawSetIntr : public DrawSet
 {
   DrawArea da;
+  View     view;
 };
 std::vector<DrawSetIntr> draw_list;
 
+// 同じファイルを別の書き方で指定しても同じものになるように
+std::string
+canonicalName(const char* fname)
+{
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  auto            p = fs::weakly_canonical(fs::path(fname), ec);
+  return ec ? std::string(fname) : p.string();
+}
+
+// FNV-1a
+uint64_t
+fnv1a(const uint8_t* p, size_t len, uint64_t h = 14695981039346656037ULL)
+{
+  for (size_t i = 0; i < len; i++)
+  {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+// 内容のハッシュ(大きさも混ぜる)
+uint64_t
+contentHash(const uint8_t* data, size_t size)
+{
+  auto hash = fnv1a(data, size);
+  return fnv1a((const uint8_t*)&size, sizeof(size), hash);
+}
+
+// パスで読み込み済みの画像
+std::shared_ptr<ImageImpl>
+findPath(const std::string& name)
+{
+  auto it = path_cache.find(name);
+  if (it == path_cache.end())
+    return {};
+  return it->second.lock();
+}
+
+// PNGのヘッダから大きさを読む(対応していない形式ならfalse)
+bool
+readHeader(const uint8_t* data, size_t size, int& w, int& h)
+{
+  // 署名(8) 長さ(4) "IHDR"(4) 幅(4) 高さ(4) 深度(1) 色の種類(1)
+  if (size < 26 || png_sig_cmp(data, 0, 8) != 0 ||
+      std::memcmp(data + 12, "IHDR", 4) != 0)
+    return false;
+  auto type = data[25];
+  if (type != PNG_COLOR_TYPE_RGB && type != PNG_COLOR_TYPE_RGB_ALPHA &&
+      type != PNG_COLOR_TYPE_GRAY_ALPHA)
+    return false;
+  w = (int)png_get_uint_32(data + 16);
+  h = (int)png_get_uint_32(data + 20);
+  return w > 0 && h > 0;
+}
+
+// アルファを乗算しておく(境界のにじみを防ぐ)
+void
+premultiply(Pixels& pix)
+{
+  if (pix.channels != 4)
+    return;
+  auto p = pix.buffer.data();
+  auto e = p + pix.buffer.size();
+  for (; p < e; p += 4)
+  {
+    unsigned a = p[3];
+    if (a == 255)
+      continue;
+    p[0] = (png_byte)((p[0] * a + 127) / 255);
+    p[1] = (png_byte)((p[1] * a + 127) / 255);
+    p[2] = (png_byte)((p[2] * a + 127) / 255);
+  }
+}
+
+// メモリ上のPNGの読み出し位置
+struct Reader
+{
+  const uint8_t* data;
+  size_t         size;
+  size_t         pos;
+};
+
+//
+void
+readData(png_structp png, png_bytep out, png_size_t len)
+{
+  auto rd = (Reader*)png_get_io_ptr(png);
+  if (rd->pos + len > rd->size)
+    png_error(png, "unexpected end of data");
+  std::memcpy(out, rd->data + rd->pos, len);
+  rd->pos += len;
+}
+
+// PNGを展開する
+bool
+decode(const uint8_t* data, size_t size, Pixels& out)
+{
+  // 読み込み失敗例外
+  class ex : public std::exception
+  {
+    const char* msg = "error";
+
+  public:
+    png_structp png  = nullptr;
+    png_infop   info = nullptr;
+
+    ex(const char* m, png_structp p = nullptr, png_infop i = nullptr)
+    {
+      msg  = m;
+      png  = p;
+      info = i;
+    }
+    ~ex() = default;
+    const char* what() const noexcept override { return msg; }
+  };
+
+  try
+  {
+    // 読み込み(これ以降はエラーは例外処理)
+    const size_t hsize = 8;
+    if (size < hsize)
+      throw(ex{"header read failed"});
+
+    auto is_png = !png_sig_cmp(data, 0, hsize);
+    if (!is_png)
+      throw(ex{"not png file"});
+
+    auto png_ptr = png_create_read_struct(
+        PNG_LIBPNG_VER_STRING, (png_voidp) nullptr, nullptr, nullptr);
+    if (!png_ptr)
+      throw(ex{"read struct create failed"});
+
+    auto info_ptr = png_create_info_struct(png_ptr);
+    if (!info_ptr)
+      throw(ex{"info struct create failed", png_ptr});
+
+    // libpngの中のエラー(壊れたデータなど)はここに戻る
+    // 戻った時に解体されない物が無いように、以降で使う物は先に作っておく
+    Reader                 rd{data, size, hsize};
+    std::vector<png_bytep> row_p;
+    if (setjmp(png_jmpbuf(png_ptr)))
+      throw(ex{"broken data", png_ptr, info_ptr});
+
+    png_set_read_fn(png_ptr, &rd, readData);
+    png_set_sig_bytes(png_ptr, hsize);
+    png_read_info(png_ptr, info_ptr);
+
+    auto w = png_get_image_width(png_ptr, info_ptr);
+    auto h = png_get_image_height(png_ptr, info_ptr);
+
+    auto type = png_get_color_type(png_ptr, info_ptr);
+    if (type != PNG_COLOR_TYPE_RGB && type != PNG_COLOR_TYPE_RGB_ALPHA &&
+        type != PNG_COLOR_TYPE_GRAY_ALPHA)
+      throw(ex{"not support format", png_ptr, info_ptr});
+
+    // グレー+アルファはRGBAにする
+    if (type == PNG_COLOR_TYPE_GRAY_ALPHA)
+      png_set_gray_to_rgb(png_ptr);
+    png_read_update_info(png_ptr, info_ptr);
+
+    auto rowbytes = png_get_rowbytes(png_ptr, info_ptr);
+    out.channels  = (int)png_get_channels(png_ptr, info_ptr);
+    out.width     = w;
+    out.height    = h;
+    out.buffer.resize(rowbytes * h);
+
+    row_p.resize(h);
+    for (png_uint_32 i = 0; i < h; i++)
+      row_p[i] = &out.buffer[i * rowbytes];
+    png_read_image(png_ptr, row_p.data());
+
+    png_read_end(png_ptr, nullptr);
+    png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+    premultiply(out);
+  }
+  catch (const ex& e)
+  {
+    // エラー
+    std::cerr << "png read error: " << e.what() << std::endl;
+    auto p = e.png;
+    auto i = e.info;
+    png_destroy_read_struct(&p, &i, nullptr);
+    return false;
+  }
+  return true;
+}
+
+//
+// 非同期読み込み
+// ワーカースレッドで展開し、終わったものはupdateで予算の範囲で転送する
+//
+constexpr size_t DefaultUploadBudget = 8 * 1024 * 1024;
+
+// 1枚分
+struct Job
+{
+  std::weak_ptr<ImageImpl> image;
+  MapFile::HandlePtr       file;
+  Pixels                   pixels{};
+  uint64_t                 hash    = 0;
+  bool                     success = false;
+};
+
+std::vector<std::thread>   workers;
+std::deque<Job>            request_queue;
+std::deque<Job>            result_list;
+std::mutex                 queue_mutex;
+std::mutex                 result_mutex;
+std::condition_variable    queue_cond;
+bool                       quit          = false;
+size_t                     pending       = 0; // 要求して転送していない数
+size_t                     upload_budget = DefaultUploadBudget;
+ImagePtr                   placeholder;
+std::shared_ptr<ImageImpl> default_placeholder;
+
+//
+void
+run()
+{
+  for (;;)
+  {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex);
+      queue_cond.wait(lock, [] { return quit || !request_queue.empty(); });
+      if (quit)
+        break;
+      job = std::move(request_queue.front());
+      request_queue.pop_front();
+    }
+
+    // 待っている間に捨てられたものは展開しない
+    if (!job.image.expired())
+    {
+      auto data   = job.file->data();
+      auto size   = job.file->size();
+      job.hash    = contentHash(data, size);
+      job.success = decode(data, size, job.pixels);
+    }
+    job.file.reset();
+
+    std::lock_guard<std::mutex> lock(result_mutex);
+    result_list.emplace_back(std::move(job));
+  }
+}
+
+//
+void
+start()
+{
+  int hc      = std::thread::hardware_concurrency();
+  int threads = std::min(std::max(hc - 1, 1), 2);
+  quit        = false;
+  for (int i = 0; i < threads; i++)
+    workers.emplace_back(run);
+}
+
+//
+void
+stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    quit = true;
+    request_queue.clear();
+  }
+  queue_cond.notify_all();
+  for (auto& w : workers)
+    w.join();
+  workers.clear();
+
+  std::lock_guard<std::mutex> lock(result_mutex);
+  result_list.clear();
+  pending = 0;
+}
+
+// 展開が終わった画像を転送する
+void
+collect()
+{
+  stats.upload_bytes = 0;
+  while (pending > 0)
+  {
+    Job job;
+    {
+      std::lock_guard<std::mutex> lock(result_mutex);
+      if (result_list.empty())
+        break;
+      // 予算を超えるなら次のフレームに回す
+      auto size = result_list.front().pixels.buffer.size();
+      if (stats.upload_bytes > 0 &&
+          stats.upload_bytes + size > upload_budget)
+        break;
+      job = std::move(result_list.front());
+      result_list.pop_front();
+    }
+    pending--;
+
+    auto image = job.image.lock();
+    if (!image)
+      continue;
+    if (!job.success)
+    {
+      image->failed = true;
+      continue;
+    }
+    image->upload(job.pixels);
+    image->hash = job.hash;
+    stats.decodes++;
+    stats.upload_bytes += job.pixels.buffer.size();
+    // 同期読み込みで同じ内容を探せるように
+    auto& hc = hash_cache[job.hash];
+    if (hc.expired())
+      hc = image;
+  }
+  stats.pending = pending;
+}
+
+// 読み込み中の画像の代わり
+ImageImpl*
+getPlaceholder()
+{
+  auto ph = dynamic_cast<ImageImpl*>(placeholder.get());
+  return ph && ph->ready ? ph : default_placeholder.get();
+}
+
 } // namespace
 
 //
 void
 initialize()
 {
-  glGenBuffers(1, &vb_obj);
-  vtx_sh = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vtx_sh, 1, &vtx_sh_s, nullptr);
-  glCompileShader(vtx_sh);
-  frg_sh = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(frg_sh, 1, &frag_sh_s, nullptr);
-  glCompileShader(frg_sh);
+  vtx_sh  = Shader::compile(GL_VERTEX_SHADER, vtx_sh_s);
+  frg_sh  = Shader::compile(GL_FRAGMENT_SHADER, frag_sh_s);
   sh_prog = glCreateProgram();
   glAttachShader(sh_prog, vtx_sh);
   glAttachShader(sh_prog, frg_sh);
+  Shader::bindOutput(sh_prog);
   glLinkProgram(sh_prog);
-  attr_coord = glGetAttribLocation(sh_prog, "coord");
-  uni_tex    = glGetUniformLocation(sh_prog, "tex");
-  uni_col    = glGetUniformLocation(sh_prog, "color");
-  uni_depth  = glGetUniformLocation(sh_prog, "Depth");
+  attr_coord   = glGetAttribLocation(sh_prog, "coord");
+  uni_tex      = glGetUniformLocation(sh_prog, "tex");
+  uni_col      = glGetUniformLocation(sh_prog, "color");
+  uni_depth    = glGetUniformLocation(sh_prog, "Depth");
+  uni_mvp      = glGetUniformLocation(sh_prog, "MVP");
+  vertex_array = Shader::createVertexArray({(GLuint)attr_coord});
 
   draw_list.reserve(1000);
   draw_list.resize(0);
+
+  // 半透明の灰色(アルファ乗算済み)
+  static const png_byte gray[4] = {64, 64, 64, 128};
+  default_placeholder         = std::make_shared<ImageImpl>();
+  default_placeholder->width  = 1;
+  default_placeholder->height = 1;
+  default_placeholder->createRGB((void*)gray, 4);
 }
 
 //
 void
 terminate()
 {
-  glDeleteBuffers(1, &vb_obj);
+  stop();
+  placeholder.reset();
+  default_placeholder.reset();
+  Shader::deleteVertexArray(vertex_array);
   glDeleteProgram(sh_prog);
   glDeleteShader(vtx_sh);
   glDeleteShader(frg_sh);
@@ -129,28 +540,41 @@ clearDrawArea()
 void
 update()
 {
+  collect();
+
   glUseProgram(sh_prog);
-  glBindBuffer(GL_ARRAY_BUFFER, vb_obj);
-  glEnableVertexAttribArray(attr_coord);
-  glVertexAttribPointer(attr_coord, 4, GL_FLOAT, GL_FALSE, 0, 0);
+  Shader::bindAttributes(vertex_array, {(GLuint)attr_coord});
 
-  glEnable(GL_TEXTURE_2D);
   glActiveTexture(GL_TEXTURE0);
   glUniform1i(uni_tex, 0);
 
   glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-  auto da  = DrawArea{};
-  auto ws  = Graphics::getWindowSize();
-  auto asp = ws.width / ws.height;
+  glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+  // 頂点はピクセルで作り, 変換は共通の投影行列に任せる
+  auto    da    = DrawArea{};
+  auto    ws    = Graphics::getWindowSize();
+  auto    hw    = ws.width * 0.5;
+  auto    hh    = ws.height * 0.5;
+  auto    view  = View{};
+  bool    first = true;
+  GLfloat mvp[16];
   for (const auto& dset : draw_list)
   {
     auto image = dynamic_cast<ImageImpl*>(dset.image.get());
     if (!image)
       continue;
+    if (!image->ready)
+      image = getPlaceholder();
     glUniform4fv(uni_col, 1, (GLfloat*)&dset.color);
     glUniform1f(uni_depth, dset.depth);
+    if (first || !view.same(dset.view))
+    {
+      view  = dset.view;
+      first = false;
+      Graphics::getProjection(mvp, view);
+      glUniformMatrix4fv(uni_mvp, 1, GL_FALSE, mvp);
+    }
 
     static const GLfloat align_scale[][4] = {
         {0.0f, 1.0f, 0.0f, -1.0f},  // Left Top
@@ -175,7 +599,10 @@ update()
         {left, bottom, 0, 1},
         {right, bottom, 1, 1},
     };
-    auto my_asp = dset.aspect ? asp : 1.0;
+    // 縦横比を保つなら縦も横幅基準の大きさにする
+    auto sy = dset.aspect ? hw : hh;
+    auto px = (dset.x + 1.0) * hw;
+    auto py = (1.0 - dset.y) * hh;
     if (dset.rotate != 0.0)
     {
       auto c = std::cos(dset.rotate);
@@ -184,29 +611,31 @@ update()
       {
         auto x = p[0];
         auto y = p[1];
-        p[0]   = x * c + y * s + dset.x;
-        p[1]   = (-x * s + y * c) * my_asp + dset.y;
+        p[0]   = (x * c + y * s) * hw + px;
+        p[1]   = py - (-x * s + y * c) * sy;
       }
     }
     else
     {
       for (auto& p : dbox)
       {
-        p[0] += dset.x;
-        p[1] = p[1] * my_asp + dset.y;
+        p[0] = p[0] * hw + px;
+        p[1] = py - p[1] * sy;
       }
     }
     image->bind();
     dset.da.set(da);
     da = dset.da;
-    glBufferData(GL_ARRAY_BUFFER, sizeof(dbox), dbox, GL_DYNAMIC_DRAW);
+    auto vr = StreamBuffer::upload(dbox, sizeof(dbox));
+    glBindBuffer(GL_ARRAY_BUFFER, vr.buffer);
+    glVertexAttribPointer(attr_coord, 4, GL_FLOAT, GL_FALSE, 0,
+                          (const void*)vr.offset);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
   }
   Graphics::disableScissor();
 
   glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glDisableVertexAttribArray(attr_coord);
-  glDisable(GL_TEXTURE_2D);
+  Shader::unbindAttributes(vertex_array, {(GLuint)attr_coord});
   glBindTexture(GL_TEXTURE_2D, 0);
 
   draw_list.resize(0);
@@ -216,94 +645,98 @@ update()
 ImagePtr
 create(const char* fname)
 {
-  // ファイル読み込み失敗例外
-  class ex : public std::exception
+  // 同じパスで読み込み済み
+  auto name = canonicalName(fname);
+  if (auto img = findPath(name))
   {
-    const char* msg = "error";
-
-  public:
-    png_structp png  = nullptr;
-    png_infop   info = nullptr;
-
-    ex(const char* m, png_structp p = nullptr, png_infop i = nullptr)
-    {
-      msg  = m;
-      png  = p;
-      info = i;
-    }
-    ~ex() = default;
-    const char* what() const noexcept override { return msg; }
-  };
+    stats.path_hits++;
+    return img;
+  }
 
   // ファイルオープン
-  FILE* fp = fopen(fname, "rb");
-  if (!fp)
+  auto file = MapFile::open(fname);
+  if (!file)
     return ImagePtr{};
 
-  auto res = ImagePtr{};
-  try
+  // 別のパスで同じ内容を読み込み済み
+  auto size  = file->size();
+  auto hash  = contentHash(file->data(), size);
+  auto image = std::shared_ptr<ImageImpl>{};
+  auto hit   = hash_cache.find(hash);
+  if (hit != hash_cache.end())
+    image = hit->second.lock();
+  if (image)
+    stats.content_hits++;
+  else
   {
-    // 読み込み(これ以降はエラーは例外処理)
-    png_byte header[8];
-    auto     hsize = sizeof(header);
-    if (fread(header, 1, hsize, fp) != hsize)
-      throw(ex{"header read failed"});
-
-    auto is_png = !png_sig_cmp(header, 0, hsize);
-    if (!is_png)
-      throw(ex{"not png file"});
-
-    auto png_ptr = png_create_read_struct(
-        PNG_LIBPNG_VER_STRING, (png_voidp) nullptr, nullptr, nullptr);
-    if (!png_ptr)
-      throw(ex{"read struct create failed"});
-
-    auto info_ptr = png_create_info_struct(png_ptr);
-    if (!info_ptr)
-      throw(ex{"info struct create failed"});
-
-    png_init_io(png_ptr, fp);
-    png_set_sig_bytes(png_ptr, hsize);
-    png_read_info(png_ptr, info_ptr);
-
-    auto w = png_get_image_width(png_ptr, info_ptr);
-    auto h = png_get_image_height(png_ptr, info_ptr);
-
-    auto type = png_get_color_type(png_ptr, info_ptr);
-    if (type != PNG_COLOR_TYPE_RGB && type != PNG_COLOR_TYPE_RGB_ALPHA &&
-        type != PNG_COLOR_TYPE_GRAY_ALPHA)
-      throw(ex{"not support format"});
-
-    auto rowbytes = png_get_rowbytes(png_ptr, info_ptr);
-    auto channels = (int)png_get_channels(png_ptr, info_ptr);
+    Pixels pix;
+    if (!decode(file->data(), size, pix))
+      return ImagePtr{};
+    stats.decodes++;
+    image       = std::make_shared<ImageImpl>();
+    image->hash = hash;
+    image->upload(pix);
+    hash_cache[hash] = image;
+  }
+  image->paths.push_back(name);
+  path_cache[name] = image;
+  return image;
+}
 
-    std::vector<png_byte>  img(rowbytes * h);
-    std::vector<png_bytep> row_p(h);
+//
+ImagePtr
+createAsync(const char* fname)
+{
+  auto name = canonicalName(fname);
+  if (auto img = findPath(name))
+  {
+    stats.path_hits++;
+    return img;
+  }
 
-    for (png_uint_32 i = 0; i < h; i++)
-      row_p[i] = &img[i * rowbytes];
-    png_read_image(png_ptr, row_p.data());
+  // 大きさだけはすぐにわかるようにする
+  int  w, h;
+  auto file = MapFile::open(fname);
+  if (!file || !readHeader(file->data(), file->size(), w, h))
+    return ImagePtr{};
 
-    auto image    = std::make_shared<ImageImpl>();
-    image->width  = w;
-    image->height = h;
-    image->createRGB(img.data(), channels);
-    res = image;
+  auto image    = std::make_shared<ImageImpl>();
+  image->width  = w;
+  image->height = h;
+  image->paths.push_back(name);
+  path_cache[name] = image;
 
-    png_read_end(png_ptr, nullptr);
-    png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
-  }
-  catch (const ex& e)
+  if (workers.empty())
+    start();
   {
-    // エラー
-    std::cerr << "png read error: " << e.what() << std::endl;
-    auto p = e.png;
-    auto i = e.info;
-    png_destroy_read_struct(&p, &i, nullptr);
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    request_queue.push_back(Job{image, file});
   }
+  queue_cond.notify_one();
+  pending++;
+  stats.pending = pending;
+  return image;
+}
+
+//
+void
+setPlaceholder(const ImagePtr& image)
+{
+  placeholder = image;
+}
 
-  fclose(fp);
-  return res;
+//
+void
+setUploadBudget(size_t bytes)
+{
+  upload_budget = bytes;
+}
+
+//
+Statistics
+getStatistics()
+{
+  return stats;
 }
 
 //
@@ -314,6 +747,7 @@ draw(const DrawSet& di)
   DrawSet&    dst = dsi;
   dst             = di;
   dsi.da          = draw_area;
+  dsi.view        = Graphics::getView();
   draw_list.emplace_back(dsi);
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "gl_def.h"
+#include <cstddef>
 #include <memory>
 
 namespace Texture2D
@@ -26,6 +27,10 @@ struct Image
   //
   virtual int getWidth() const  = 0;
   virtual int getHeight() const = 0;
+
+  // 表示できるか(非同期読み込みが終わるまでは代わりの画像で表示する)
+  virtual bool isReady() const  = 0;
+  virtual bool isFailed() const = 0;
 };
 
 using ImagePtr = std::shared_ptr<Image>;
@@ -58,8 +63,35 @@ void update();
 
 // イメージオブジェクトの作成
 // const char*: ファイル名(png)
+// 同じファイル(または同じ内容)が読み込み済みならそれを共有する
 ImagePtr create(const char*);
 
+// イメージオブジェクトの非同期作成
+// すぐに返り(大きさはわかる)、展開はワーカースレッドで、転送はupdateで行う
+// ファイルが無いかpngでなければ空を返す
+ImagePtr createAsync(const char*);
+
+// 読み込み中の画像の代わりに表示する画像(空なら半透明の灰色)
+void setPlaceholder(const ImagePtr&);
+
+// 1フレームでテクスチャに転送するバイト数の上限(最低1枚は転送する)
+void setUploadBudget(size_t bytes);
+
+// 画像キャッシュの統計
+struct Statistics
+{
+  size_t images;         // 読み込み済みの画像数
+  size_t resident_bytes; // テクスチャの使用メモリ
+  size_t decodes;        // PNGを展開した回数(累計)
+  size_t path_hits;      // 同じパスで展開を省いた回数(累計)
+  size_t content_hits;   // 同じ内容で展開を省いた回数(累計)
+  size_t pending;        // 非同期読み込みで転送待ちの画像数
+  size_t upload_bytes;   // 直前のupdateで非同期読み込みの画像を転送した量
+};
+
+//
+Statistics getStatistics();
+
 //
 void draw(const DrawSet& di);
 
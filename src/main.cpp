@@ -331,21 +331,14 @@ setup(FontDraw::WidgetPtr font)
 using DBoxList = std::initializer_list<DrawBox::BoxPtr>;
 using ImgList  = std::initializer_list<Texture2D::ImagePtr>;
 bool
-onUpdate(FontDraw::WidgetPtr font, DBoxList dbl, ImgList imgl)
+onUpdate(FontDraw::WidgetPtr font, DBoxList dbl, ImgList imgl,
+         const Primitive2D::MeshPtr& prim)
 {
-  // プリミティブを描画
+  // プリミティブを描画(作成済みのメッシュなので転送は無い)
   if (DispPrim)
   {
-    static const Primitive2D::VertexList vl = {
-        {-0.4f, -0.4f, 1.0f, 0.0f, 0.0f},
-        {0.4f, -0.4f, 0.0f, 1.0f, 0.0f},
-        {0.4f, 0.4f, 0.0f, 0.0f, 1.0f},
-        {-0.4f, 0.4f, 1.0f, 1.0f, 1.0f},
-    };
     Primitive2D::setDepth(0.99f);
-    Primitive2D::drawQuads(vl);
-    static const Primitive2D::Vertex v = {0.0f, 0.0f, 0.5f, 1.0f, 1.0f};
-    Primitive2D::drawCircle(v, 0.5f, 32, 8.0f);
+    Primitive2D::drawMesh(prim);
   }
 
   // グラフィック座標系で毎フレーム描画
@@ -422,6 +415,12 @@ main(int argc, char** argv)
   auto font = GLLib::initialize("Sample", fontname, Width, Height);
   if (!font)
     return 1;
+  // 同梱のフォントは等幅なので整形せずに並べるはず
+  if (!font->isMonospace())
+    std::cerr << "warning: " << fontname << " is not laid out as monospace"
+              << std::endl;
+  FontDraw::setDiskCacheDirectory("cache");
+  FontDraw::prewarm(font, {FontDraw::RangeASCII, FontDraw::RangeKana});
 
   setup(font);
   GLLib::bindLayer();
@@ -434,18 +433,39 @@ main(int argc, char** argv)
   dbox2->setDrawSize(600, 750);
   dbox1->setLink(dbox2.get());
 
-  // Image
-  auto img1 = Texture2D::create("res/test.png");
-  auto img2 = Texture2D::create("res/textest.png");
+  // Image(展開は裏で行い、終わるまでは代わりの画像で表示する)
+  auto img1 = Texture2D::createAsync("res/test.png");
+  auto img2 = Texture2D::createAsync("res/textest.png");
   auto imgl = {img1, img2};
 
+  // 変わらない図形は1度だけ転送する
+  // (線の太さはピクセルなので、ウィンドウの大きさが決まる最初のフレームで作る)
+  auto build_prim = []() {
+    static const Primitive2D::VertexList vl = {
+        {-0.4f, -0.4f, 1.0f, 0.0f, 0.0f},
+        {0.4f, -0.4f, 0.0f, 1.0f, 0.0f},
+        {0.4f, 0.4f, 0.0f, 0.0f, 1.0f},
+        {-0.4f, 0.4f, 1.0f, 1.0f, 1.0f},
+    };
+    Primitive2D::drawQuads(vl);
+    static const Primitive2D::Vertex v = {0.0f, 0.0f, 0.5f, 1.0f, 1.0f};
+    Primitive2D::drawCircle(v, 0.5f, 32, 8.0f);
+  };
+  Primitive2D::MeshPtr prim;
+
   // フレームループ
   for (;;)
   {
-    if (GLLib::update([&]() { return onUpdate(font, dbl, imgl); }) == false)
+    auto func = [&]() {
+      if (!prim)
+        prim = Primitive2D::createMesh(build_prim);
+      return onUpdate(font, dbl, imgl, prim);
+    };
+    if (GLLib::update(func) == false)
       break;
   }
 
+  prim.reset();
   GLLib::terminate();
   return 0;
 }